@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ng
+{
+
+struct AllocationStats
+{
+    int64_t allocations_n = 0;
+    int64_t allocated_bytes_n = 0;
+
+    // Highest sum of the bytes allocated and not yet freed at any moment, relative to the start.
+    // The buffers allocated before the start are excluded, e.g. the reused DetectionWorkspace and
+    // the thread_local buffers. Freeing them does not lower the live bytes below 0, so they do not
+    // hide the later allocations
+    int64_t peak_live_bytes_n = 0;
+};
+
+
+// Counters the allocations are charged to, together with the counters of the enclosing accounts.
+// A free is charged to the account of the freeing thread
+struct AllocationAccount
+{
+    AllocationAccount* parent = nullptr;
+
+    std::atomic<int64_t> allocations_n{ 0 };
+    std::atomic<int64_t> allocated_bytes_n{ 0 };
+    // Clamped at 0, see AllocationStats::peak_live_bytes_n
+    std::atomic<int64_t> live_bytes_n{ 0 };
+    std::atomic<int64_t> peak_live_bytes_n{ 0 };
+};
+
+
+// The operator new and delete of the process and the cv::Mat buffers are counted with NG_ENABLE_ALLOCATION_TRACKING only,
+// otherwise the stats stay 0
+bool is_allocation_tracking_enabled();
+
+
+// Makes the cv::Mat buffers allocated from now on counted, the buffers allocated before are not.
+// Call once at the start of the program, does nothing without NG_ENABLE_ALLOCATION_TRACKING
+void install_allocation_tracking();
+
+
+// Charges <size> bytes to the accounts of the calling thread, called by the allocator hooks
+void record_allocation(size_t const size);
+
+
+void record_deallocation(size_t const size);
+
+
+// Account of the calling thread, null outside of the scopes
+AllocationAccount* get_allocation_account();
+
+
+// Counts the allocations of the calling thread from its construction to its destruction.
+// The scopes nest, the threads the work is split to join the scope with AllocationAccountBinding.
+// The allocations of the OpenCV worker threads are not counted
+class AllocationScope
+{
+public:
+    AllocationScope();
+
+    ~AllocationScope();
+
+    AllocationScope(AllocationScope const&) = delete;
+    AllocationScope& operator=(AllocationScope const&) = delete;
+
+    AllocationStats get_stats() const;
+
+private:
+    AllocationAccount m_account;
+};
+
+
+// Charges the allocations of the calling thread to <account> (if not null) from its construction to its destruction,
+// e.g. for a task which does a part of the work of a scope on another thread
+class AllocationAccountBinding
+{
+public:
+    explicit AllocationAccountBinding(AllocationAccount* const account);
+
+    ~AllocationAccountBinding();
+
+    AllocationAccountBinding(AllocationAccountBinding const&) = delete;
+    AllocationAccountBinding& operator=(AllocationAccountBinding const&) = delete;
+
+private:
+    AllocationAccount* m_account_previous;
+};
+
+}
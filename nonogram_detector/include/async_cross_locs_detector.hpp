@@ -0,0 +1,76 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "cross_locs_detector.hpp"
+#include "deadline.hpp"
+#include "detection_hints.hpp"
+#include "detection_result.hpp"
+#include "detection_workspace.hpp"
+#include "thread_pool.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Runs CrossLocsDetector::detect on its own workers, the workers share the detector and keep their own workspaces.
+// The images are shared, not copied, and must not be modified until their detection completes
+class AsyncCrossLocsDetector
+{
+public:
+    // <exception> is null if the detection succeeded
+    using CompletionCallback = std::function<void(DetectionResult const& detection_result, std::exception_ptr const& exception)>;
+
+    AsyncCrossLocsDetector(
+        CrossLocsDetector const& cross_locs_detector,
+        int const workers_n,
+        int const queue_capacity);
+
+    // Blocks while the submission queue is full
+    std::future<DetectionResult> submit(
+        std::shared_ptr<cv::Mat const> const& image,
+        Deadline const& deadline = Deadline());
+
+    // Blocks while the submission queue is full, see CrossLocsDetector::detect for <hints>
+    std::future<DetectionResult> submit(
+        std::shared_ptr<cv::Mat const> const& image,
+        DetectionHints const& hints,
+        Deadline const& deadline = Deadline());
+
+    // Blocks while the submission queue is full, <completion_callback> is called on a worker
+    void submit(
+        std::shared_ptr<cv::Mat const> const& image,
+        CompletionCallback const& completion_callback,
+        Deadline const& deadline = Deadline());
+
+    // Returns false instead of blocking if the submission queue is full
+    bool try_submit(
+        std::shared_ptr<cv::Mat const> const& image,
+        CompletionCallback const& completion_callback,
+        Deadline const& deadline = Deadline());
+
+    int get_queue_depth() const;
+
+    // Ratio of the workers running a detection at the moment
+    double get_utilization() const;
+
+private:
+    CrossLocsDetector const M_CROSS_LOCS_DETECTOR;
+    std::vector<DetectionWorkspace> m_workspaces;
+
+    // Declared last so the workers are joined before the workspaces are destroyed
+    ThreadPool m_thread_pool;
+
+    std::function<void(int)> make_task(
+        std::shared_ptr<cv::Mat const> const& image,
+        DetectionHints const& hints,
+        CompletionCallback const& completion_callback,
+        Deadline const& deadline);
+};
+
+}
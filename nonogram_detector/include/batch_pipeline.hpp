@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "cross_locs_detector.hpp"
+#include "deadline.hpp"
+#include "detection_result.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+struct BatchOptions
+{
+    // Number of threads of every stage
+    int decode_workers_n = 2;
+    int detect_workers_n = static_cast<int>(std::thread::hardware_concurrency());
+    int write_workers_n = 1;
+
+    // Capacity of the queues between the stages, bounds the number of decoded images in memory
+    int queue_capacity = 16;
+
+    // JPEG images are decoded at a reduced scale which keeps their larger side at least this long,
+    // usually the resize width (height) max of the detector. 0 decodes at full size
+    float decode_width_height_min = 0.0f;
+};
+
+
+struct BatchRecord
+{
+    // Position of the input in the list, the records are written in the order they complete
+    size_t index = 0;
+    std::string input_path;
+
+    // The file was read and decoded, the detection result is valid
+    bool is_decoded = false;
+
+    // See DetectionHints::input_scale, the grids are in the coordinates of the encoded image
+    float input_scale = 1.0f;
+
+    DetectionResult detection_result;
+};
+
+
+// Runs the batch as decode, detect and write stages connected by bounded lock-free queues,
+// so reading and decoding the next files overlaps with the detection.
+// The files are memory-mapped and decoded from the mapped bytes, the detect workers share the detector
+class BatchPipeline
+{
+public:
+    // Called on a write worker, must be thread safe if there are several of them
+    using RecordWriter = std::function<void(BatchRecord const& batch_record)>;
+
+    BatchPipeline(
+        CrossLocsDetector const& cross_locs_detector,
+        BatchOptions const& options = BatchOptions());
+
+    // Blocks until every input is written or <deadline> expires, the inputs not read by then are skipped.
+    // Returns the number of written records
+    size_t run(
+        std::vector<std::string> const& input_paths,
+        RecordWriter const& record_writer,
+        Deadline const& deadline = Deadline());
+
+private:
+    struct BatchItem
+    {
+        BatchRecord record;
+        cv::Mat image;
+    };
+
+    BatchOptions const M_OPTIONS;
+    CrossLocsDetector const M_CROSS_LOCS_DETECTOR;
+
+    // Spins briefly, then sleeps, while the queue on the other side is full (empty)
+    static void back_off(int& attempts_n);
+
+    static void push(BoundedQueue<BatchItem>& queue, BatchItem&& item);
+
+    // Returns false once the queue is empty and no upstream worker is active
+    static bool pop(
+        BoundedQueue<BatchItem>& queue,
+        std::atomic<int> const& upstream_workers_n,
+        BatchItem& item);
+};
+
+}
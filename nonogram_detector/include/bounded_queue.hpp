@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace ng
+{
+
+// Lock-free multi-producer multi-consumer queue of a fixed capacity (D. Vyukov's bounded queue).
+// Every cell carries a sequence number, which tells a producer (consumer) if the cell is free (full)
+// for its position, so the producers and the consumers only compete for their own position counter
+template <typename T>
+class BoundedQueue
+{
+public:
+    // The capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t const capacity)
+        : M_MASK(get_capacity(capacity) - 1)
+        , m_cells(new Cell[M_MASK + 1])
+        , m_enqueue_position(0)
+        , m_dequeue_position(0)
+    {
+        for (size_t i = 0; i <= M_MASK; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(BoundedQueue const&) = delete;
+    BoundedQueue& operator=(BoundedQueue const&) = delete;
+
+    // Returns false if the queue is full
+    bool try_push(T&& value)
+    {
+        auto position = m_enqueue_position.load(std::memory_order_relaxed);
+
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[position & M_MASK];
+
+            auto const sequence = cell->sequence.load(std::memory_order_acquire);
+            auto const difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if (difference == 0)
+            {
+                if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool try_pop(T& value)
+    {
+        auto position = m_dequeue_position.load(std::memory_order_relaxed);
+
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[position & M_MASK];
+
+            auto const sequence = cell->sequence.load(std::memory_order_acquire);
+            auto const difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(position + M_MASK + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keeps the producer and the consumer counters on separate cache lines
+    static size_t const CACHE_LINE_SIZE = 64;
+
+    size_t const M_MASK;
+    std::unique_ptr<Cell[]> m_cells;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_enqueue_position;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_dequeue_position;
+
+    static size_t get_capacity(size_t const capacity)
+    {
+        size_t capacity_power_of_two = 2;
+        while (capacity_power_of_two < capacity)
+        {
+            capacity_power_of_two *= 2;
+        }
+
+        return capacity_power_of_two;
+    }
+};
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace ng
+{
+
+// Copies share the same flag, so a token can be handed to the workers and cancelled from outside
+class CancellationToken
+{
+public:
+    CancellationToken();
+
+    void cancel() const;
+
+    bool is_cancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_is_cancelled;
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+enum class CellArea : uint32_t
+{
+    MAIN = 0,
+    TOP = 1,
+    LEFT = 2
+};
+
+
+// The file starts with the header, then the index of <entries_n> entries sorted by (area, row, col),
+// then the atlas of the raw cell images, each continuous and at <offset> from the start of the atlas
+struct CellArchiveHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entries_n;
+    uint32_t reserved;
+};
+
+
+struct CellArchiveEntry
+{
+    CellArea area;
+    uint32_t row;
+    uint32_t col;
+    int32_t rows;
+    int32_t cols;
+
+    // OpenCV type of the cell image, e.g. CV_8UC1
+    int32_t type;
+
+    uint64_t offset;
+};
+
+
+// Collects the cell images of a puzzle and writes them into a single file with one sequential write
+class CellArchiveWriter
+{
+public:
+    // <cell_images> are indexed by [row][col], replaces the cells of <area> added before
+    void add(CellArea const area, std::vector<std::vector<cv::Mat>> const& cell_images);
+
+    bool write(std::string const& file_path) const;
+
+private:
+    std::vector<std::pair<CellArea, std::vector<std::vector<cv::Mat>>>> m_areas;
+};
+
+
+// Maps the archive and returns the cell images as views of the mapped file, without copying them.
+// The views are valid while the reader is open and must not be modified
+class CellArchiveReader
+{
+public:
+    CellArchiveReader();
+
+    // Checks the header, the cell types and that the index and the cells are within the file
+    bool open(std::string const& file_path);
+
+    void close();
+
+    std::vector<CellArchiveEntry> const& get_entries() const;
+
+    cv::Mat get_cell_image(size_t const entry_index) const;
+
+    // The boolean flag shows if the cell is in the archive
+    std::pair<bool, cv::Mat> find_cell_image(CellArea const area, int const row, int const col) const;
+
+private:
+    MappedFile m_mapped_file;
+    std::vector<CellArchiveEntry> m_entries;
+    unsigned char const* m_atlas;
+};
+
+}
@@ -1,17 +1,27 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include <map>
 #include <utility>
 #include <vector>
 
+#include "cancellation_token.hpp"
+#include "deadline.hpp"
+#include "detection_hints.hpp"
+#include "detection_options.hpp"
+#include "detection_result.hpp"
+#include "detection_workspace.hpp"
 #include "point_compare.hpp"
+#include "threshold_profile.hpp"
 
 #include <opencv2/opencv.hpp>
 
 namespace ng
 {
 
+// The configured detector is immutable and detect() is reentrant,
+// so one instance may be shared by the workers, each with its own DetectionWorkspace
 class CrossLocsDetector
 {
 public:
@@ -21,10 +31,47 @@ public:
         double const threshold_c,
         int const find_cell_side_length_min,
         int const find_cell_side_length_max,
-        double const similarity_ratio_min);
+        double const similarity_ratio_min,
+        DetectionOptions const& options = DetectionOptions());
+
+    // Takes the resize and threshold parameters from a profile tuned for the source of the images
+    CrossLocsDetector(
+        ThresholdProfile const& threshold_profile,
+        int const find_cell_side_length_min,
+        int const find_cell_side_length_max,
+        double const similarity_ratio_min,
+        DetectionOptions const& options = DetectionOptions());
 
     // First value means if something was detected
-    std::tuple<bool, cv::Mat, cv::Mat, cv::Mat> detect(cv::Mat const& image);
+    std::tuple<bool, cv::Mat, cv::Mat, cv::Mat> detect(cv::Mat const& image) const;
+
+    // Stops between the seed cell side lengths and between the BFS steps once <deadline> expires
+    // and returns the grids found so far flagged as partial
+    DetectionResult detect(cv::Mat const& image, Deadline const& deadline) const;
+
+    // Crops the image to <hints.quad> and stops the grid expansion at the expected grid size
+    DetectionResult detect(
+        cv::Mat const& image,
+        DetectionHints const& hints,
+        Deadline const& deadline = Deadline()) const;
+
+    // Same as above, the scratch images are kept in <workspace> for the next call
+    DetectionResult detect(
+        cv::Mat const& image,
+        DetectionHints const& hints,
+        Deadline const& deadline,
+        DetectionWorkspace& workspace) const;
+
+    // Runs the stages after the threshold, so the caller may cache the resized and the thresholded images.
+    // <image_gray> and <image_thresholded> are the crop of the input image at <offset> resized by <scale>,
+    // the grids are returned in the coordinates of the input image
+    DetectionResult detect_thresholded(
+        cv::Mat const& image_gray,
+        cv::Mat const& image_thresholded,
+        float const scale,
+        cv::Point const& offset,
+        DetectionHints const& hints = DetectionHints(),
+        Deadline const& deadline = Deadline()) const;
 
     static cv::Mat draw(
         cv::Mat const& image,
@@ -39,6 +86,7 @@ private:
     int const M_FIND_CELL_SIDE_LENGTH_MIN;
     int const M_FIND_CELL_SIDE_LENGTH_MAX;
     double const M_SIMILARITY_RATIO_MIN;
+    DetectionOptions const M_OPTIONS;
 
     static cv::Point const INDICES_DELTA_UP;
     static cv::Point const INDICES_DELTA_RIGHT;
@@ -47,26 +95,85 @@ private:
 
     static std::vector<cv::Point> const INDICES_DELTAS;
 
+    static int const LATTICE_MODEL_INDICES_RADIUS;
+    static int const LATTICE_MODEL_POINTS_MIN;
+    static double const LATTICE_MODEL_RESIDUAL_FACTOR;
+    static int const LATTICE_MODEL_SEARCH_RADIUS_MIN;
+
+    static int const CELL_SIDE_LENGTH_COARSE_MIN;
+
+    static float const CELL_PITCH_SCALE_MAX;
+    static float const CELL_PITCH_TOLERANCE_RATIO;
+
+    static int const THICK_LINES_STRIDE;
+    static double const THICK_LINE_WIDTH_RATIO_MIN;
 
-    static std::tuple<bool, int, cv::Point> find_cell_side_length_cell_loc(
+
+    // Finds the seed and the grids on <image_thresholded>, refines them in the pyramid mode
+    // and maps them to the input image
+    DetectionResult detect_grids(
+        cv::Mat const& image_gray,
+        cv::Mat const& image_thresholded,
+        float const scale,
+        cv::Point2f const& offset,
+        int const find_cell_side_length_min,
+        int const find_cell_side_length_max,
+        cv::Size const main_grid_size,
+        Deadline const& deadline) const;
+
+
+    // The double is the square mask score of the found cell.
+    // Stops between the cell side lengths once <deadline> expires
+    static std::tuple<bool, int, cv::Point, double> find_cell_side_length_cell_loc(
         cv::Mat const& image_thresholded,
         cv::Rect const& image_thresholded_roi,
         int const cell_side_length_min,
         int const cell_side_length_max,
-        double const similarity_ratio_min);
+        double const similarity_ratio_min,
+        Deadline const& deadline);
+
+
+    // Searches the cell in <options.seed_search_tiles> x <options.seed_search_tiles> tiles concurrently
+    // and returns the best scored one, the central tiles win ties
+    static std::tuple<bool, int, cv::Point> find_seed(
+        cv::Mat const& image_thresholded,
+        int const roi_side_length,
+        int const cell_side_length_min,
+        int const cell_side_length_max,
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        Deadline const& deadline);
+
+
+    // Fits an affine model (indices -> cross location) to the found crosses
+    // within <indices_radius> of <indices> and predicts the cross location at <indices>.
+    // The boolean flag shows if the model was fitted, the double is the max residual of the fit.
+    // Runs at every BFS step, so it solves the 3x3 normal equations directly and keeps its buffer per thread
+    static std::tuple<bool, cv::Point, double> predict_cross_loc(
+        std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map,
+        cv::Point const& indices,
+        int const indices_radius);
 
 
     // <indices_init> must correspond with <cross_locs_init>
+    // <roi_size> is the largest search window, it shrinks where the local lattice model is accurate
+    // The found indices never span more than <indices_span_max>, 0 means unbounded
+    // <cross_locs_known_map> are crosses found beforehand, the search resumes from their neighbors
+    // <predict_from_lattice_model> false searches only the full window, see DetectionOptions
     static std::map<cv::Point, cv::Point, PointCompare> get_cross_locs_map(
         cv::Mat const& image_thresholded,
         std::vector<cv::Point> const& indices_init,
         std::vector<cv::Point> const& cross_locs_init,
+        std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_known_map,
         std::vector<cv::Point> const& indices_deltas,
         std::vector<cv::Point> const& cross_loc_deltas,
         cv::Size const roi_size,
         cv::Mat const& mask_cross,
         int const mask_cross_perimeter,
-        double const similarity_ratio_min);
+        double const similarity_ratio_min,
+        cv::Size const indices_span_max,
+        bool const predict_from_lattice_model,
+        Deadline const& deadline);
 
 
     static cv::Rect get_bounding_rectangle(
@@ -83,25 +190,100 @@ private:
         int const cell_side_length);
 
 
-    static cv::Mat get_cross_locs_main_mat(
+    // Finds the crosses on the row and the column through <cross_loc_init> and on the border of the grid,
+    // fits a homography to them and fills the interior from it.
+    // The boolean flag shows if the homography passed the check on a sample of the interior crosses,
+    // otherwise the map holds the crosses found so far
+    static std::pair<bool, std::map<cv::Point, cv::Point, PointCompare>> get_cross_locs_main_map_sparse(
         cv::Mat const& image_thresholded,
         cv::Point const& cross_loc_init,
         int const cell_side_length,
-        double const similarity_ratio_min);
+        cv::Mat const& mask_cross,
+        int const mask_cross_perimeter,
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        cv::Size const main_grid_size,
+        Deadline const& deadline);
+
+
+    // Measures the lines around <cross_loc_init>, finds the crosses of the thick lines 5 cells at a time,
+    // interpolates the crosses in between and refines them in a small window, then finds the rest of the grid.
+    // The boolean flag shows if the thick lines were found and the grid fits them,
+    // otherwise the map holds the crosses found so far
+    static std::pair<bool, std::map<cv::Point, cv::Point, PointCompare>> get_cross_locs_main_map_stride(
+        cv::Mat const& image_thresholded,
+        cv::Point const& cross_loc_init,
+        int const cell_side_length,
+        cv::Mat const& mask_cross,
+        int const mask_cross_perimeter,
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        cv::Size const main_grid_size,
+        Deadline const& deadline);
 
 
-    static cv::Mat get_cross_locs_top_mat(
+    // <main_grid_size> is the expected number of cells, 0 if unknown.
+    // The ints are the number of crosses found by the search, before augment,
+    // and the number of crosses inside the found grid which augment had to interpolate
+    static std::tuple<cv::Mat, int, int> get_cross_locs_main_mat(
+        cv::Mat const& image_thresholded,
+        cv::Point const& cross_loc_init,
+        int const cell_side_length,
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        cv::Size const main_grid_size,
+        Deadline const& deadline);
+
+
+    // The int is the number of crosses found by the search, before augment
+    static std::pair<cv::Mat, int> get_cross_locs_top_mat(
         cv::Mat const& image_thresholded,
         cv::Mat const& cross_locs_main_mat,
         int const cell_side_length,
-        double const similarity_ratio_min);
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        cv::Size const main_grid_size,
+        Deadline const& deadline);
 
 
-    static cv::Mat get_cross_locs_left_mat(
+    // The int is the number of crosses found by the search, before augment
+    static std::pair<cv::Mat, int> get_cross_locs_left_mat(
         cv::Mat const& image_thresholded,
         cv::Mat const& cross_locs_main_mat,
         int const cell_side_length,
-        double const similarity_ratio_min);
+        double const similarity_ratio_min,
+        DetectionOptions const& options,
+        cv::Size const main_grid_size,
+        Deadline const& deadline);
+
+
+    // Upscales <cross_locs_mat> found on a pyramid level <scale_factor> times smaller than <image_thresholded>
+    // and searches every cross in a small window around its upscaled location.
+    // Once <deadline> expires the rest of the crosses are only upscaled,
+    // the boolean flag shows if every cross was searched
+    static std::pair<cv::Mat, bool> refine(
+        cv::Mat const& image_thresholded,
+        cv::Mat const& cross_locs_mat,
+        int const scale_factor,
+        cv::Mat const& mask_cross,
+        int const mask_cross_perimeter,
+        double const similarity_ratio_min,
+        Deadline const& deadline);
+
+
+    // Runs <stages> on <options.scheduler>, one by one if there is none
+    static void run_stages(std::vector<std::function<void()>> const& stages, DetectionOptions const& options);
+
+
+    static StageProgress get_stage_progress(int const found_n, bool const is_completed);
+
+
+    // Maps cross locations from the working image back to the input image, keeps (-1, -1) as is
+    static cv::Mat rescale(cv::Mat const& cross_locs_mat, float const scale, cv::Point2f const& offset);
+
+
+    // Bounding rectangle of <hints.quad> with a margin, the whole image if there is no quad
+    static cv::Rect get_crop_roi(cv::Size const& image_size, DetectionHints const& hints);
 
 
     static void print(cv::Mat const& cross_locs_mat);
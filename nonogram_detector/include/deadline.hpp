@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "cancellation_token.hpp"
+
+namespace ng
+{
+
+// Expires at a time point or once any of its cancellation tokens is cancelled
+class Deadline
+{
+public:
+    // Never expires unless cancelled
+    explicit Deadline(CancellationToken const& cancellation_token = CancellationToken());
+
+    Deadline(
+        std::chrono::steady_clock::time_point const& time_point,
+        CancellationToken const& cancellation_token = CancellationToken());
+
+    static Deadline from_budget(
+        std::chrono::steady_clock::duration const& budget,
+        CancellationToken const& cancellation_token = CancellationToken());
+
+    // Returns a copy which also expires once <cancellation_token> is cancelled
+    Deadline with_cancellation_token(CancellationToken const& cancellation_token) const;
+
+    bool is_expired() const;
+
+private:
+    std::chrono::steady_clock::time_point m_time_point;
+    std::vector<CancellationToken> m_cancellation_tokens;
+};
+
+}
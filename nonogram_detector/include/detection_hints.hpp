@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Optional prior knowledge about the puzzle in the image
+struct DetectionHints
+{
+    // Expected number of cells of the main grid, 0 if unknown
+    int main_grid_rows = 0;
+    int main_grid_cols = 0;
+
+    // Approximate corners of the puzzle in the input image coordinates, empty if unknown.
+    // The image is cropped to their bounding rectangle before resizing
+    std::vector<cv::Point2f> quad;
+
+    // Margin added around the bounding rectangle of <quad>, relative to its size
+    float quad_margin_ratio = 0.05f;
+
+    // Size of the input image relative to the original one, e.g. 0.25 for a JPEG decoded at 1/4 scale.
+    // <quad> is given and the grids are returned in the coordinates of the original image
+    float input_scale = 1.0f;
+};
+
+}
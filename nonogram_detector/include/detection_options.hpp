@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+
+#include "work_stealing_scheduler.hpp"
+
+namespace ng
+{
+
+enum class MainGridMode
+{
+    // Template matches every cross of the main grid
+    FULL,
+
+    // Template matches the crosses on the border of the main grid and on a sample of the interior,
+    // the rest is filled from a homography. Falls back to FULL if the sample does not fit the homography
+    SPARSE,
+
+    // Template matches the crosses of the thick lines drawn every 5 cells, 5 cells at a time,
+    // the crosses in between are interpolated and refined in a small window.
+    // Falls back to FULL if there are no thick lines or the grid does not fit them
+    STRIDE
+};
+
+
+struct DetectionOptions
+{
+    MainGridMode main_grid_mode = MainGridMode::FULL;
+
+    // The BFS predicts every cross from an affine model of the found neighbors and searches a window
+    // sized by the model error first, then the full window around the fixed step prediction on a miss.
+    // false searches only the full window
+    bool predict_from_lattice_model = true;
+
+    // SPARSE: number of interior crosses checked against the homography
+    int verification_sample_size = 16;
+
+    // SPARSE: max distance between a checked cross and its prediction, relative to the cell side length
+    double verification_error_ratio_max = 0.15;
+
+    // SPARSE, STRIDE: ratio of the checked (interpolated) crosses which may fail before falling back to FULL
+    double verification_failure_ratio_max = 0.1;
+
+    // STRIDE: min ratio of the thick cross mask covered by the lines,
+    // the crosses of the thin lines cover it only partially
+    double stride_similarity_ratio_min = 0.75;
+
+    // Number of times the image is halved for the seed and the lattice search,
+    // the found crosses are then refined at the working resolution. 0 disables the pyramid
+    int pyramid_levels = 0;
+
+    // The seed cell is searched in a grid of <seed_search_tiles> x <seed_search_tiles> tiles,
+    // 1 searches only the center of the image
+    int seed_search_tiles = 1;
+
+    // A seed with this square mask score cancels the search in the other tiles
+    double seed_similarity_ratio_confident = 0.97;
+
+    // Crops the image to the grid lines found on a thumbnail before the detection,
+    // unless the hints already give the puzzle quad
+    bool localize_page = false;
+
+    int localization_width_height_max = 256;
+
+    // Margin added around the found grid lines, relative to their bounding rectangle size
+    float localization_margin_ratio = 0.1f;
+
+    // If positive, the image is resized so that the cells estimated on a thumbnail become this long
+    // instead of fitting the image into the resize width (height) max.
+    // The seed search is then narrowed to the cell side lengths around the resized pitch,
+    // which stays below the target if the scale is capped (a very small pitch)
+    int cell_pitch_target = 0;
+
+    int pitch_estimation_width_height_max = 640;
+
+    // Runs the seed tiles, the top and the left grids and the refinement of the grids in parallel,
+    // see make_scheduler. Null runs the stages one by one and the seed tiles on their own threads
+    std::shared_ptr<WorkStealingScheduler> scheduler;
+};
+
+}
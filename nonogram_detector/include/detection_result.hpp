@@ -0,0 +1,50 @@
+#pragma once
+
+#include "allocation_tracking.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+struct StageProgress
+{
+    bool is_completed = false;
+
+    // Number of crosses (or seed cells) found by the stage so far
+    int found_n = 0;
+
+    // Number of crosses inside the grid which were not found and were interpolated, main grid only
+    int holes_n = 0;
+};
+
+
+struct DetectionResult
+{
+    // The seed cell was found, the grids below are valid
+    bool is_found = false;
+
+    // The deadline expired before all the stages completed, the grids hold what was found so far
+    bool is_partial = false;
+
+    // Scale of the image the grids were detected on relative to the input (original) image
+    float scale = 0.0f;
+
+    // Side length of the main grid cells in the coordinates of the input image, 0 if the seed was not found
+    float cell_pitch = 0.0f;
+
+    StageProgress seed;
+    StageProgress main_grid;
+    StageProgress top_grid;
+    StageProgress left_grid;
+
+    // CV_32SC2 cross locations in the coordinates of the input image, (-1, -1) where not found
+    cv::Mat cross_locs_main_mat;
+    cv::Mat cross_locs_top_mat;
+    cv::Mat cross_locs_left_mat;
+
+    // Heap allocations of the detect call, including its scheduler tasks and the returned grids
+    AllocationStats allocations;
+};
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "async_cross_locs_detector.hpp"
+#include "cancellation_token.hpp"
+#include "cross_locs_detector.hpp"
+#include "grid_serialization.hpp"
+#include "threshold_profile.hpp"
+
+namespace ng
+{
+
+// Every frame is a little endian uint32 size followed by the payload.
+// A request payload is the request type and the encoded image (the UTF-8 path of the image file),
+// a response payload is the status and the binary grid record, see encode_grid_record
+enum class DetectionRequestType : uint8_t
+{
+    IMAGE = 0,
+    PATH = 1
+};
+
+
+enum class DetectionResponseStatus : uint8_t
+{
+    OK = 0,
+
+    // The image was not read or decoded, the record holds the source only
+    NOT_DECODED = 1,
+
+    // The request was malformed or the detection failed
+    FAILED = 2
+};
+
+
+struct DetectionServerOptions
+{
+    int workers_n = static_cast<int>(std::thread::hardware_concurrency());
+    int queue_capacity = 16;
+
+    // See BatchOptions::decode_width_height_min
+    float decode_width_height_min = 0.0f;
+
+    // Detection time limit of a request, 0 means unlimited
+    std::chrono::milliseconds detection_budget = std::chrono::milliseconds(0);
+};
+
+
+// Keeps the detectors warm between the requests, so a request costs the decoding and the detection only.
+// Every connection is read on its own detached thread, the detections run on the shared workers.
+// Unix only, the serve functions return false on Windows
+class DetectionServer
+{
+public:
+    // <threshold_profile> is the profile of <cross_locs_detector>, it is written into the records
+    DetectionServer(
+        CrossLocsDetector const& cross_locs_detector,
+        ThresholdProfile const& threshold_profile,
+        DetectionServerOptions const& options = DetectionServerOptions());
+
+    // Stops the server
+    ~DetectionServer();
+
+    DetectionServer(DetectionServer const&) = delete;
+    DetectionServer& operator=(DetectionServer const&) = delete;
+
+    // Listens on a Unix domain socket at <socket_path> and blocks until stop() is called.
+    // A stale socket file is replaced
+    bool serve(std::string const& socket_path);
+
+    // Serves the requests from <input_fd> with the responses to <output_fd>, e.g. stdin and stdout,
+    // and blocks until the input ends
+    bool serve_stream(int const input_fd, int const output_fd);
+
+    // May be called from any thread, cancels the running detections and closes the connections
+    void stop();
+
+    // Handles a request payload and returns the response payload
+    std::vector<unsigned char> handle_request(std::vector<unsigned char> const& request);
+
+private:
+    ThresholdProfile const M_THRESHOLD_PROFILE;
+    DetectionServerOptions const M_OPTIONS;
+
+    AsyncCrossLocsDetector m_async_cross_locs_detector;
+    CancellationToken m_cancellation_token;
+
+    std::mutex m_mutex;
+    int m_listen_fd;
+    bool m_is_stopping;
+
+    // Descriptors of the live connections, serve() waits until the set is empty
+    std::set<int> m_connection_fds;
+    std::condition_variable m_connections_closed;
+
+    void serve_connection(int const connection_fd);
+
+    static std::vector<unsigned char> make_response(
+        DetectionResponseStatus const status,
+        GridRecord const& grid_record);
+};
+
+
+// Sends the requests to a DetectionServer one at a time and waits for the responses
+class DetectionClient
+{
+public:
+    DetectionClient();
+
+    ~DetectionClient();
+
+    DetectionClient(DetectionClient const&) = delete;
+    DetectionClient& operator=(DetectionClient const&) = delete;
+
+    bool connect(std::string const& socket_path);
+
+    void close();
+
+    // The boolean flag shows if the response was received and decoded
+    std::tuple<bool, DetectionResponseStatus, GridRecord> detect_path(std::string const& image_path);
+
+    // <data> is the encoded image, e.g. a JPEG file
+    std::tuple<bool, DetectionResponseStatus, GridRecord> detect_image(unsigned char const* data, size_t const size);
+
+private:
+    int m_fd;
+
+    std::tuple<bool, DetectionResponseStatus, GridRecord> send_request(std::vector<unsigned char> const& request);
+};
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Scratch images of one CrossLocsDetector::detect call.
+// A worker keeps its own workspace between the calls, so the buffers of the same sized images are reused.
+// The detector itself is immutable, one instance may be shared by any number of threads
+struct DetectionWorkspace
+{
+    cv::Mat image_resized;
+    cv::Mat image_gray;
+    cv::Mat image_thresholded;
+};
+
+}
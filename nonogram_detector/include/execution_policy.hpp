@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+
+#include "work_stealing_scheduler.hpp"
+
+namespace ng
+{
+
+// Split of the cores between the images detected at the same time and the parallelism inside one detection.
+// Their product stays within the cores: the image workers and the scheduler workers together make one thread a core,
+// and OpenCV adds no threads of its own
+struct ExecutionPolicy
+{
+    // Images detected at the same time, e.g. BatchOptions::detect_workers_n
+    int image_workers_n = 1;
+
+    // Threads of one detection: the seed tiles, the top and the left grids, the refinement
+    int detect_threads_n = 1;
+
+    // Threads of the parallel regions of cv::filter2D, cv::resize, cv::adaptiveThreshold and cv::warpPerspective.
+    // 1 from get_execution_policy, the detection threads are the scheduler workers
+    int opencv_threads_n = 1;
+};
+
+
+// Gives every image a worker while there are more images than cores,
+// otherwise splits the cores left over between the detections of the <images_n> images
+ExecutionPolicy get_execution_policy(
+    int const images_n,
+    int const cores_n = static_cast<int>(std::thread::hardware_concurrency()));
+
+
+// Sets the number of threads of OpenCV, it is process wide
+void apply_execution_policy(ExecutionPolicy const& execution_policy);
+
+
+// Scheduler for DetectionOptions::scheduler, its workers and the image workers share the cores.
+// Null if every detection runs on one thread
+std::shared_ptr<WorkStealingScheduler> make_scheduler(ExecutionPolicy const& execution_policy);
+
+}
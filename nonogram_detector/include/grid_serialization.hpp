@@ -0,0 +1,107 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "detection_result.hpp"
+#include "mapped_file.hpp"
+#include "threshold_profile.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Detection result of one image with the parameters it was detected with
+struct GridRecord
+{
+    // Usually the path of the image
+    std::string source;
+
+    ThresholdProfile threshold_profile;
+    DetectionResult detection_result;
+};
+
+
+enum class GridRecordFormat
+{
+    // Every grid is stored as an affine lattice model and the small residuals of the crosses from it
+    BINARY,
+
+    // Flat lists of the cross locations, for debugging
+    JSON
+};
+
+
+// Binary encoding of a single record, see GridRecordWriter for the layout
+std::vector<unsigned char> encode_grid_record(GridRecord const& grid_record);
+
+
+// The boolean flag shows if <data> holds a valid record of exactly <size> bytes
+std::pair<bool, GridRecord> decode_grid_record(unsigned char const* data, size_t const size);
+
+
+// Writes the records one by one, so a file may hold many records.
+// The binary file starts with the magic "NGGR" and the version, then every record is prefixed with its size.
+// A record holds the flags, the stage progress, the allocation stats, the metadata and the main, top and left grids.
+// A grid holds its size, a bitmap of the found crosses if some are missing, the float lattice model
+// (indices -> cross location) fitted to the found crosses, and the residuals of the crosses from the model,
+// predicted from the left, upper and upper-left residuals and zigzag varint coded
+class GridRecordWriter
+{
+public:
+    GridRecordWriter();
+
+    // Finishes the file
+    ~GridRecordWriter();
+
+    GridRecordWriter(GridRecordWriter const&) = delete;
+    GridRecordWriter& operator=(GridRecordWriter const&) = delete;
+
+    // Closes the previous file
+    bool open(std::string const& file_path, GridRecordFormat const format);
+
+    bool write(GridRecord const& grid_record);
+
+    // Finishes the file, the boolean flag shows if everything was written
+    bool close();
+
+    bool is_open() const;
+
+private:
+    GridRecordFormat m_format;
+    std::ofstream m_file;
+    cv::FileStorage m_file_storage;
+};
+
+
+// Reads the records one by one, the format is detected by the magic
+class GridRecordReader
+{
+public:
+    GridRecordReader();
+
+    GridRecordReader(GridRecordReader const&) = delete;
+    GridRecordReader& operator=(GridRecordReader const&) = delete;
+
+    bool open(std::string const& file_path);
+
+    void close();
+
+    // The boolean flag is false at the end of the file or on a broken record
+    std::pair<bool, GridRecord> read();
+
+private:
+    GridRecordFormat m_format;
+
+    MappedFile m_mapped_file;
+    size_t m_offset;
+
+    cv::FileStorage m_file_storage;
+    cv::FileNodeIterator m_records_it;
+    cv::FileNodeIterator m_records_end;
+};
+
+}
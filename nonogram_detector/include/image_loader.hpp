@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Width and height from the frame header of a JPEG file, without decoding it.
+// The boolean flag shows if the file is a JPEG and the header was found
+std::pair<bool, cv::Size> read_jpeg_size(unsigned char const* data, size_t const size);
+
+
+std::pair<bool, cv::Size> read_jpeg_size(std::string const& file_path);
+
+
+// Decodes the image in gray for the detection from the encoded bytes, e.g. of a mapped file.
+// A JPEG is decoded straight at 1/2, 1/4 or 1/8 scale, the smallest one which keeps its larger side
+// at least <width_height_min>. The float is the scale of the returned image relative to the encoded one,
+// see DetectionHints::input_scale
+std::pair<cv::Mat, float> decode_image_reduced(
+    unsigned char const* data,
+    size_t const size,
+    float const width_height_min);
+
+
+// Maps the file and decodes it with decode_image_reduced
+std::pair<cv::Mat, float> load_image_reduced(std::string const& file_path, float const width_height_min);
+
+}
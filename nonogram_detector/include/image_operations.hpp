@@ -25,6 +25,14 @@ cv::Mat threshold(
     double const c);
 
 
+// Same as above, writes to <image_thresholded>, so its buffer is reused for the images of the same size
+void threshold(
+    cv::Mat const& image_gray,
+    int const block_size,
+    double const c,
+    cv::Mat& image_thresholded);
+
+
 // If roi size is odd, center will be in the bottom right of 4 central pixels
 cv::Rect get_roi(cv::Point const& center, cv::Size const& roi_size);
 
@@ -38,6 +46,15 @@ std::pair<bool, cv::Point> find_kernel_loc(
     cv::Point const& anchor);
 
 
+// Same as find_kernel_loc, also returns the normalized peak value
+std::tuple<bool, cv::Point, double> find_kernel_loc_peak(
+    cv::Mat const& image_thresholded,
+    cv::Mat const& kernel,
+    double const max,
+    double const similarity_ratio_min,
+    cv::Point const& anchor);
+
+
 bool is_inside(cv::Rect const& rect, cv::Rect const& sub_rect);
 
 
@@ -50,6 +67,45 @@ std::pair<bool, cv::Point> find_kernel_loc(
     cv::Point const& anchor = cv::Point(-1, -1));
 
 
+std::tuple<bool, cv::Point, double> find_kernel_loc_peak(
+    cv::Mat const& image,
+    cv::Rect const& roi,
+    cv::Mat const& kernel,
+    double const max,
+    double const similarity_ratio_min,
+    cv::Point const& anchor = cv::Point(-1, -1));
+
+
+// Resizes <image> to a thumbnail with the longest side of <thumbnail_width_height_max> and thresholds it,
+// also returns the scale of the thumbnail
+std::pair<cv::Mat, float> get_thumbnail_thresholded(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max);
+
+
+// Returns horizontal and vertical lines at least <line_length> long (morphological opening)
+std::pair<cv::Mat, cv::Mat> get_lines(
+    cv::Mat const& image_thresholded,
+    int const line_length);
+
+
+// Finds the grid lines on a thumbnail of <image> with the longest side of <thumbnail_width_height_max>
+// and returns the bounding rectangle of their crossings with a <margin_ratio> margin in <image> coordinates.
+// The boolean flag shows if enough crossings were found
+std::pair<bool, cv::Rect> localize_grid(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max,
+    float const margin_ratio);
+
+
+// Estimates the cell pitch in <image> pixels from the period of the grid lines
+// on a thumbnail with the longest side of <thumbnail_width_height_max>.
+// The boolean flag shows if the lines were periodic enough
+std::pair<bool, float> estimate_cell_pitch(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max);
+
+
 std::vector<std::vector<cv::Mat>> get_cell_warped_images_vector(cv::Mat const& image, cv::Mat const& cross_locs);
 
 
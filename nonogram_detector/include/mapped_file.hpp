@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ng
+{
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    // Closes the previous file, an empty file is not mapped
+    bool open(std::string const& file_path);
+
+    void close();
+
+    bool is_open() const;
+
+    unsigned char const* get_data() const;
+
+    size_t get_size() const;
+
+private:
+#ifdef _WIN32
+    void* m_file_handle;
+    void* m_mapping_handle;
+#else
+    int m_file_descriptor;
+#endif
+
+    void* m_data;
+    size_t m_size;
+};
+
+}
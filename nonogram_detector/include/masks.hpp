@@ -29,4 +29,18 @@ std::pair<cv::Mat, int> get_mask_cross(int const length, int const margin);
 std::pair<cv::Mat, int> get_mask_cross(int const length);
 
 
+// Mask for the crosses of the main grid with cells of <cell_side_length>,
+// the line width is estimated as a quarter of the cell side length
+std::pair<cv::Mat, int> get_mask_cross_main(int const cell_side_length);
+
+
+// Mask for the crosses of the thick lines of the main grid with cells of <cell_side_length>,
+// the lines of <line_width> are covered with ones
+std::pair<cv::Mat, int> get_mask_cross_thick(int const cell_side_length, int const line_width);
+
+
+// Mask for the crosses of the top and left grids with cells of <cell_side_length>
+std::pair<cv::Mat, int> get_mask_cross_clues(int const cell_side_length);
+
+
 }
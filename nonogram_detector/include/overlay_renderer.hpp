@@ -0,0 +1,71 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+struct OverlayStyle
+{
+    cv::Scalar color = cv::Scalar(255, 0, 0);
+
+    // In the pixels of the output
+    int radius = 2;
+
+    // Negative fills the circles
+    int thickness = -1;
+
+    bool is_visible = true;
+};
+
+
+// Draws the main, the top and the left grids over an image in one pass into a reused buffer.
+// The image is fitted into <output_width_height_max> and the cross locations are transformed to it,
+// so the drawing costs as much as the output size and not the size of the photo
+class OverlayRenderer
+{
+public:
+    // 0 keeps the size of the image
+    explicit OverlayRenderer(
+        int const output_width_height_max = 0,
+        OverlayStyle const& main_style = get_style(cv::Scalar(255, 0, 0)),
+        OverlayStyle const& top_style = get_style(cv::Scalar(0, 255, 0)),
+        OverlayStyle const& left_style = get_style(cv::Scalar(0, 0, 255)));
+
+    // Resizes <image> into the background the grids are drawn over.
+    // The background is kept until the next call, call it again once the image changes
+    void set_image(cv::Mat const& image);
+
+    // Draws over the image of the last set_image. The grids are CV_32SC2 in the coordinates of that image,
+    // (-1, -1) crosses are skipped. The result is valid until the next call
+    cv::Mat const& render(
+        cv::Mat const& cross_locs_main_mat,
+        cv::Mat const& cross_locs_top_mat,
+        cv::Mat const& cross_locs_left_mat);
+
+    // Calls set_image and render, for the images drawn once
+    cv::Mat const& render(
+        cv::Mat const& image,
+        cv::Mat const& cross_locs_main_mat,
+        cv::Mat const& cross_locs_top_mat,
+        cv::Mat const& cross_locs_left_mat);
+
+    // Scale from the coordinates of the last rendered image to the output
+    float get_scale() const;
+
+private:
+    int const M_OUTPUT_WIDTH_HEIGHT_MAX;
+    OverlayStyle const M_MAIN_STYLE;
+    OverlayStyle const M_TOP_STYLE;
+    OverlayStyle const M_LEFT_STYLE;
+
+    float m_scale;
+    cv::Mat m_background;
+    cv::Mat m_output;
+
+    static OverlayStyle get_style(cv::Scalar const& color);
+
+    void draw(cv::Mat const& cross_locs_mat, OverlayStyle const& style);
+};
+
+}
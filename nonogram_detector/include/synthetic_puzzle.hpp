@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Puzzle image with the known crosses of its main grid, for the checks and the benchmark
+struct SyntheticPuzzle
+{
+    cv::Mat image;
+
+    // CV_32FC2 of (rows + 1) x (cols + 1) crosses in the image coordinates
+    cv::Mat cross_locs_main_mat;
+};
+
+
+// Draws a puzzle with <rows> x <cols> cells, thick lines every 5 cells and the clue grids above and on the left,
+// then warps it with a random perspective and adds blur and noise.
+// The perspective moves every corner by up to <perspective_jitter_ratio> of the shorter image side
+SyntheticPuzzle generate_synthetic_puzzle(
+    cv::RNG& rng,
+    int const rows,
+    int const cols,
+    int const cell_side_length,
+    float const perspective_jitter_ratio = 0.03f);
+
+
+// Puzzles of 10 to 30 cells a side with cells of 18 to 39 pixels.
+// The same <seed> gives the same puzzles, so every run measures the same images
+std::vector<SyntheticPuzzle> generate_synthetic_puzzles(
+    int const puzzles_n,
+    uint64_t const seed = 20191102,
+    float const perspective_jitter_ratio = 0.03f);
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ng
+{
+
+// Fixed number of workers fed from a bounded queue.
+// A task receives the index of the worker running it, so the caller may keep per-worker state
+class ThreadPool
+{
+public:
+    ThreadPool(int const workers_n, int const queue_capacity);
+
+    // Runs the queued tasks and joins the workers
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    // Blocks while the queue is full
+    void submit(std::function<void(int)> task);
+
+    // Returns false instead of blocking if the queue is full
+    bool try_submit(std::function<void(int)> task);
+
+    int get_workers_n() const;
+
+    int get_queue_depth() const;
+
+    int get_busy_workers_n() const;
+
+private:
+    int const M_QUEUE_CAPACITY;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queue_not_empty;
+    std::condition_variable m_queue_not_full;
+    std::deque<std::function<void(int)>> m_queue;
+    bool m_is_stopping;
+
+    std::atomic<int> m_busy_workers_n;
+    std::vector<std::thread> m_workers;
+
+    void run(int const worker_index);
+};
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ng
+{
+
+// Resize and threshold parameters which suit the images of one source, e.g. a publication
+struct ThresholdProfile
+{
+    std::string name;
+
+    float resize_width_height_max = 1000.0f;
+    int threshold_block_size = 15;
+    double threshold_c = 10.0;
+};
+
+
+// Writes <threshold_profiles> to a YAML (JSON) file, the format follows the extension of <file_path>
+bool save_threshold_profiles(
+    std::string const& file_path,
+    std::vector<ThresholdProfile> const& threshold_profiles);
+
+
+// The boolean flag shows if the file was read
+std::pair<bool, std::vector<ThresholdProfile>> load_threshold_profiles(std::string const& file_path);
+
+
+// The boolean flag shows if the profile with <name> was found in the file
+std::pair<bool, ThresholdProfile> load_threshold_profile(
+    std::string const& file_path,
+    std::string const& name);
+
+
+// Replaces the profile with the same name or adds a new one
+void upsert_threshold_profile(
+    std::vector<ThresholdProfile>& threshold_profiles,
+    ThresholdProfile const& threshold_profile);
+
+}
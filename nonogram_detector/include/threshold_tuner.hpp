@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "deadline.hpp"
+#include "detection_options.hpp"
+#include "threshold_profile.hpp"
+
+#include <opencv2/opencv.hpp>
+
+namespace ng
+{
+
+// Every combination of the values is a candidate, even block sizes are skipped
+struct ThresholdCandidates
+{
+    std::vector<float> resize_width_height_max_values = { 1000.0f, 1200.0f, 1600.0f, 2200.0f };
+    std::vector<int> threshold_block_size_values = { 7, 11, 15, 21, 31 };
+    std::vector<double> threshold_c_values = { 2.0, 4.0, 7.0, 10.0, 15.0 };
+};
+
+
+// Picks the resize and threshold parameters for a set of sample images of one source.
+// A candidate is scored on every image by cheap structural metrics of the detected grids:
+// the seed is found, the main grid is large, regular and has few holes filled by the interpolation
+class ThresholdTuner
+{
+public:
+    ThresholdTuner(
+        int const find_cell_side_length_min,
+        int const find_cell_side_length_max,
+        double const similarity_ratio_min,
+        DetectionOptions const& options = DetectionOptions(),
+        int const workers_n = static_cast<int>(std::thread::hardware_concurrency()));
+
+    // Evaluates the candidates on <images> in parallel and returns the best one named <name>.
+    // The boolean flag shows if any candidate found a grid, the double is the mean score per image.
+    // The candidates not evaluated before <deadline> expires are skipped
+    std::tuple<bool, ThresholdProfile, double> tune(
+        std::string const& name,
+        std::vector<cv::Mat> const& images,
+        ThresholdCandidates const& threshold_candidates = ThresholdCandidates(),
+        Deadline const& deadline = Deadline()) const;
+
+private:
+    int const M_FIND_CELL_SIDE_LENGTH_MIN;
+    int const M_FIND_CELL_SIDE_LENGTH_MAX;
+    double const M_SIMILARITY_RATIO_MIN;
+    DetectionOptions const M_OPTIONS;
+    int const M_WORKERS_N;
+
+    static double const IRREGULARITY_RATIO_MAX;
+
+    static std::vector<ThresholdProfile> get_threshold_profiles(
+        std::string const& name,
+        ThresholdCandidates const& threshold_candidates);
+
+    // Mean deviation of the crosses from the midpoint of their neighbors relative to the mean cell side length.
+    // The boolean flag shows if the grid has at least one cross with both neighbors
+    static std::pair<bool, double> get_irregularity(cv::Mat const& cross_locs_mat);
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <utility>
+
+// The spans are compiled in with NG_ENABLE_TRACING only, otherwise the macros expand to nothing
+// and their arguments are not evaluated
+#ifdef NG_ENABLE_TRACING
+
+#define NG_TRACE_SPAN(span, name) ng::TraceSpan span(name)
+
+// Records every <period>-th span of the call site on every thread, for the spans in the hot loops
+#define NG_TRACE_SPAN_SAMPLED(span, name, period) \
+    static thread_local unsigned int span##_sample_index = 0; \
+    ng::TraceSpan span(name, span##_sample_index++ % (period) == 0)
+
+#define NG_TRACE_ARG(span, key, value) span.set_arg(key, static_cast<double>(value))
+
+#else
+
+#define NG_TRACE_SPAN(span, name)
+#define NG_TRACE_SPAN_SAMPLED(span, name, period)
+#define NG_TRACE_ARG(span, key, value)
+
+#endif
+
+namespace ng
+{
+
+// Clears the recorded spans and starts recording
+void start_tracing();
+
+
+void stop_tracing();
+
+
+bool is_tracing();
+
+
+// Writes the spans recorded so far as Chrome trace events, see chrome://tracing or ui.perfetto.dev
+bool write_chrome_trace(std::string const& file_path);
+
+
+// Records the time from its construction to its destruction on the current thread, if tracing is on.
+// <name> and the argument keys must be string literals
+class TraceSpan
+{
+public:
+    explicit TraceSpan(char const* name, bool const is_sampled = true);
+
+    ~TraceSpan();
+
+    TraceSpan(TraceSpan const&) = delete;
+    TraceSpan& operator=(TraceSpan const&) = delete;
+
+    // Up to ARGS_N_MAX arguments are kept
+    void set_arg(char const* key, double const value);
+
+    static int const ARGS_N_MAX = 4;
+
+private:
+    char const* m_name;
+    bool m_is_recording;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::array<std::pair<char const*, double>, ARGS_N_MAX> m_args;
+    int m_args_n;
+};
+
+}
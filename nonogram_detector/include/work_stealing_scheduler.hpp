@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ng
+{
+
+// Every worker runs the tasks of its own deque newest first and steals the oldest tasks of the others when idle.
+// The tasks pushed by the other threads go to a shared deque which the workers steal from as well.
+// A thread waiting for its parallel_for runs the queued tasks meanwhile, so the loops may be nested,
+// e.g. the images run as tasks and every detection splits its stages into tasks on the same workers
+class WorkStealingScheduler
+{
+public:
+    // 0 workers runs everything on the calling threads
+    explicit WorkStealingScheduler(int const workers_n);
+
+    // Runs the queued tasks and joins the workers
+    ~WorkStealingScheduler();
+
+    WorkStealingScheduler(WorkStealingScheduler const&) = delete;
+    WorkStealingScheduler& operator=(WorkStealingScheduler const&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Calls <body> for every index in [0, <n>) and returns once all the calls are done.
+    // The calling thread takes part, at most <workers_n> + 1 indices run at the same time.
+    // If a call throws, the indices not started yet are skipped and the first exception is rethrown
+    // here once the running calls are done
+    void parallel_for(int const n, std::function<void(int)> const& body);
+
+    int get_workers_n() const;
+
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // One deque per worker, the last one is shared by the other threads
+    std::vector<std::unique_ptr<TaskQueue>> m_task_queues;
+
+    std::mutex m_mutex;
+    std::condition_variable m_task_pushed;
+    std::atomic<int> m_tasks_n;
+    bool m_is_stopping;
+
+    std::vector<std::thread> m_workers;
+
+    void run(int const worker_index);
+
+    // Index of the deque of the calling thread
+    int get_task_queue_index() const;
+
+    void push(int const task_queue_index, std::function<void()> task);
+
+    // Pops a task from the deque at <task_queue_index>, otherwise steals one, and runs it.
+    // Returns false if there were no tasks
+    bool try_run_task(int const task_queue_index);
+};
+
+}
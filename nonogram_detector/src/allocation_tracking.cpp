@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <opencv2/opencv.hpp>
+
+#include "allocation_tracking.hpp"
+
+namespace ng
+{
+
+namespace
+{
+
+// Plain pointer, so it is usable from operator new at any point of the thread lifetime
+thread_local AllocationAccount* t_allocation_account = nullptr;
+
+
+void update_max(std::atomic<int64_t>& value_max, int64_t const value)
+{
+    auto value_max_current = value_max.load(std::memory_order_relaxed);
+    while (value > value_max_current &&
+        !value_max.compare_exchange_weak(value_max_current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+// Not below 0, the bytes freed may have been allocated before the account started
+void subtract_clamped(std::atomic<int64_t>& value, int64_t const size)
+{
+    auto value_current = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(
+        value_current,
+        std::max<int64_t>(value_current - size, 0),
+        std::memory_order_relaxed))
+    {
+    }
+}
+
+
+#ifdef NG_ENABLE_ALLOCATION_TRACKING
+
+// Wraps the standard allocator and counts the buffers it allocates, the user data is not counted
+class TrackingMatAllocator : public cv::MatAllocator
+{
+public:
+    TrackingMatAllocator()
+        : M_MAT_ALLOCATOR(cv::Mat::getStdAllocator())
+    {
+    }
+
+    cv::UMatData* allocate(
+        int dims,
+        int const* sizes,
+        int type,
+        void* data,
+        size_t* step,
+        cv::AccessFlag flags,
+        cv::UMatUsageFlags usage_flags) const override
+    {
+        auto const u = M_MAT_ALLOCATOR->allocate(dims, sizes, type, data, step, flags, usage_flags);
+
+        // The buffer is released through this allocator, so the deallocation is counted as well
+        if (u)
+        {
+            u->currAllocator = this;
+            u->prevAllocator = this;
+
+            if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+            {
+                record_allocation(u->size);
+            }
+        }
+
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override
+    {
+        return M_MAT_ALLOCATOR->allocate(u, access_flags, usage_flags);
+    }
+
+    void deallocate(cv::UMatData* u) const override
+    {
+        if (u && !(u->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            record_deallocation(u->size);
+        }
+
+        M_MAT_ALLOCATOR->deallocate(u);
+    }
+
+private:
+    cv::MatAllocator* const M_MAT_ALLOCATOR;
+};
+
+#endif
+
+}
+
+
+bool is_allocation_tracking_enabled()
+{
+#ifdef NG_ENABLE_ALLOCATION_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void install_allocation_tracking()
+{
+#ifdef NG_ENABLE_ALLOCATION_TRACKING
+    // Outlives every cv::Mat, the buffers may be released from static destructors
+    static auto const tracking_mat_allocator = new TrackingMatAllocator();
+
+    cv::Mat::setDefaultAllocator(tracking_mat_allocator);
+#endif
+}
+
+
+void record_allocation(size_t const size)
+{
+    auto const size_signed = static_cast<int64_t>(size);
+
+    for (auto account = t_allocation_account; account; account = account->parent)
+    {
+        account->allocations_n.fetch_add(1, std::memory_order_relaxed);
+        account->allocated_bytes_n.fetch_add(size_signed, std::memory_order_relaxed);
+
+        auto const live_bytes_n = account->live_bytes_n.fetch_add(size_signed, std::memory_order_relaxed) + size_signed;
+        update_max(account->peak_live_bytes_n, live_bytes_n);
+    }
+}
+
+
+void record_deallocation(size_t const size)
+{
+    for (auto account = t_allocation_account; account; account = account->parent)
+    {
+        subtract_clamped(account->live_bytes_n, static_cast<int64_t>(size));
+    }
+}
+
+
+AllocationAccount* get_allocation_account()
+{
+    return t_allocation_account;
+}
+
+
+AllocationScope::AllocationScope()
+{
+    m_account.parent = t_allocation_account;
+    t_allocation_account = &m_account;
+}
+
+
+AllocationScope::~AllocationScope()
+{
+    t_allocation_account = m_account.parent;
+}
+
+
+AllocationStats AllocationScope::get_stats() const
+{
+    AllocationStats allocation_stats;
+    allocation_stats.allocations_n = m_account.allocations_n.load();
+    allocation_stats.allocated_bytes_n = m_account.allocated_bytes_n.load();
+    allocation_stats.peak_live_bytes_n = m_account.peak_live_bytes_n.load();
+
+    return allocation_stats;
+}
+
+
+AllocationAccountBinding::AllocationAccountBinding(AllocationAccount* const account)
+    : m_account_previous(t_allocation_account)
+{
+    if (account)
+    {
+        t_allocation_account = account;
+    }
+}
+
+
+AllocationAccountBinding::~AllocationAccountBinding()
+{
+    t_allocation_account = m_account_previous;
+}
+
+}
+
+
+#ifdef NG_ENABLE_ALLOCATION_TRACKING
+
+// The replaced operators keep the size in front of the block, so the unsized delete can count it
+namespace
+{
+
+size_t const ALLOCATION_HEADER_SIZE = alignof(std::max_align_t);
+
+
+void* allocate_tracked(size_t const size)
+{
+    auto const block = static_cast<unsigned char*>(std::malloc(ALLOCATION_HEADER_SIZE + size));
+    if (!block)
+    {
+        return nullptr;
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    ng::record_allocation(size);
+
+    return block + ALLOCATION_HEADER_SIZE;
+}
+
+
+void deallocate_tracked(void* const ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    auto const block = static_cast<unsigned char*>(ptr) - ALLOCATION_HEADER_SIZE;
+    ng::record_deallocation(*reinterpret_cast<size_t*>(block));
+
+    std::free(block);
+}
+
+
+void* allocate_tracked_or_throw(size_t const size)
+{
+    auto const ptr = allocate_tracked(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+}
+
+
+void* operator new(size_t size)
+{
+    return allocate_tracked_or_throw(size);
+}
+
+
+void* operator new[](size_t size)
+{
+    return allocate_tracked_or_throw(size);
+}
+
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate_tracked(size);
+}
+
+
+void* operator new[](size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate_tracked(size);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    deallocate_tracked(ptr);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "async_cross_locs_detector.hpp"
+
+namespace ng
+{
+
+AsyncCrossLocsDetector::AsyncCrossLocsDetector(
+    CrossLocsDetector const& cross_locs_detector,
+    int const workers_n,
+    int const queue_capacity)
+    : M_CROSS_LOCS_DETECTOR(cross_locs_detector)
+    , m_workspaces(std::max(workers_n, 1))
+    , m_thread_pool(workers_n, queue_capacity)
+{
+}
+
+
+std::future<DetectionResult> AsyncCrossLocsDetector::submit(
+    std::shared_ptr<cv::Mat const> const& image,
+    Deadline const& deadline)
+{
+    return submit(image, DetectionHints(), deadline);
+}
+
+
+std::future<DetectionResult> AsyncCrossLocsDetector::submit(
+    std::shared_ptr<cv::Mat const> const& image,
+    DetectionHints const& hints,
+    Deadline const& deadline)
+{
+    auto const promise = std::make_shared<std::promise<DetectionResult>>();
+    auto future = promise->get_future();
+
+    m_thread_pool.submit(make_task(
+        image,
+        hints,
+        [promise](DetectionResult const& detection_result, std::exception_ptr const& exception)
+        {
+            if (exception)
+            {
+                promise->set_exception(exception);
+            }
+            else
+            {
+                promise->set_value(detection_result);
+            }
+        },
+        deadline));
+
+    return future;
+}
+
+
+void AsyncCrossLocsDetector::submit(
+    std::shared_ptr<cv::Mat const> const& image,
+    CompletionCallback const& completion_callback,
+    Deadline const& deadline)
+{
+    m_thread_pool.submit(make_task(image, DetectionHints(), completion_callback, deadline));
+}
+
+
+bool AsyncCrossLocsDetector::try_submit(
+    std::shared_ptr<cv::Mat const> const& image,
+    CompletionCallback const& completion_callback,
+    Deadline const& deadline)
+{
+    return m_thread_pool.try_submit(make_task(image, DetectionHints(), completion_callback, deadline));
+}
+
+
+int AsyncCrossLocsDetector::get_queue_depth() const
+{
+    return m_thread_pool.get_queue_depth();
+}
+
+
+double AsyncCrossLocsDetector::get_utilization() const
+{
+    return static_cast<double>(m_thread_pool.get_busy_workers_n()) / m_thread_pool.get_workers_n();
+}
+
+
+std::function<void(int)> AsyncCrossLocsDetector::make_task(
+    std::shared_ptr<cv::Mat const> const& image,
+    DetectionHints const& hints,
+    CompletionCallback const& completion_callback,
+    Deadline const& deadline)
+{
+    return [this, image, hints, completion_callback, deadline](int const worker_index)
+    {
+        DetectionResult detection_result;
+        std::exception_ptr exception;
+
+        try
+        {
+            detection_result = M_CROSS_LOCS_DETECTOR.detect(*image, hints, deadline, m_workspaces[worker_index]);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        completion_callback(detection_result, exception);
+    };
+}
+
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "batch_pipeline.hpp"
+#include "image_loader.hpp"
+#include "mapped_file.hpp"
+
+namespace ng
+{
+
+BatchPipeline::BatchPipeline(
+    CrossLocsDetector const& cross_locs_detector,
+    BatchOptions const& options)
+    : M_OPTIONS(options)
+    , M_CROSS_LOCS_DETECTOR(cross_locs_detector)
+{
+}
+
+
+size_t BatchPipeline::run(
+    std::vector<std::string> const& input_paths,
+    RecordWriter const& record_writer,
+    Deadline const& deadline)
+{
+    auto const decode_workers_n = std::max(M_OPTIONS.decode_workers_n, 1);
+    auto const detect_workers_n = std::max(M_OPTIONS.detect_workers_n, 1);
+    auto const write_workers_n = std::max(M_OPTIONS.write_workers_n, 1);
+
+    auto const queue_capacity = static_cast<size_t>(std::max(M_OPTIONS.queue_capacity, 1));
+    BoundedQueue<BatchItem> decoded_queue(queue_capacity);
+    BoundedQueue<BatchItem> detected_queue(queue_capacity);
+
+    // A stage finishes once its queue is drained and all the workers of the previous stage are done
+    std::atomic<size_t> input_index_next(0);
+    std::atomic<int> decode_workers_active_n(decode_workers_n);
+    std::atomic<int> detect_workers_active_n(detect_workers_n);
+    std::atomic<size_t> written_n(0);
+
+    auto const decode_width_height_min = M_OPTIONS.decode_width_height_min > 0.0f ?
+        M_OPTIONS.decode_width_height_min :
+        std::numeric_limits<float>::max();
+
+    auto const decode = [&]()
+    {
+        while (!deadline.is_expired())
+        {
+            auto const input_index = input_index_next.fetch_add(1);
+            if (input_index >= input_paths.size())
+            {
+                break;
+            }
+
+            BatchItem item;
+            item.record.index = input_index;
+            item.record.input_path = input_paths[input_index];
+
+            MappedFile mapped_file;
+            if (mapped_file.open(item.record.input_path))
+            {
+                try
+                {
+                    std::tie(item.image, item.record.input_scale) = decode_image_reduced(
+                        mapped_file.get_data(),
+                        mapped_file.get_size(),
+                        decode_width_height_min);
+                }
+                catch (cv::Exception const&)
+                {
+                    item.image = cv::Mat();
+                }
+
+                item.record.is_decoded = !item.image.empty();
+            }
+
+            // The failed inputs are written too, so every input gets a record
+            push(decoded_queue, std::move(item));
+        }
+
+        decode_workers_active_n.fetch_sub(1, std::memory_order_release);
+    };
+
+    auto const detect = [&]()
+    {
+        DetectionWorkspace workspace;
+
+        BatchItem item;
+        while (pop(decoded_queue, decode_workers_active_n, item))
+        {
+            if (item.record.is_decoded && !deadline.is_expired())
+            {
+                DetectionHints hints;
+                hints.input_scale = item.record.input_scale;
+
+                try
+                {
+                    item.record.detection_result = M_CROSS_LOCS_DETECTOR.detect(item.image, hints, deadline, workspace);
+                }
+                catch (cv::Exception const&)
+                {
+                    item.record.detection_result = DetectionResult();
+                }
+            }
+
+            item.image.release();
+
+            push(detected_queue, std::move(item));
+        }
+
+        detect_workers_active_n.fetch_sub(1, std::memory_order_release);
+    };
+
+    auto const write = [&]()
+    {
+        BatchItem item;
+        while (pop(detected_queue, detect_workers_active_n, item))
+        {
+            record_writer(item.record);
+
+            written_n.fetch_add(1);
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 0; i < decode_workers_n; ++i)
+    {
+        workers.emplace_back(decode);
+    }
+
+    for (int i = 0; i < detect_workers_n; ++i)
+    {
+        workers.emplace_back(detect);
+    }
+
+    for (int i = 0; i < write_workers_n; ++i)
+    {
+        workers.emplace_back(write);
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    return written_n.load();
+}
+
+
+void BatchPipeline::back_off(int& attempts_n)
+{
+    auto const SPINS_N = 64;
+
+    if (attempts_n < SPINS_N)
+    {
+        ++attempts_n;
+
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+
+void BatchPipeline::push(BoundedQueue<BatchItem>& queue, BatchItem&& item)
+{
+    int attempts_n = 0;
+    while (!queue.try_push(std::move(item)))
+    {
+        back_off(attempts_n);
+    }
+}
+
+
+bool BatchPipeline::pop(
+    BoundedQueue<BatchItem>& queue,
+    std::atomic<int> const& upstream_workers_n,
+    BatchItem& item)
+{
+    int attempts_n = 0;
+    while (true)
+    {
+        if (queue.try_pop(item))
+        {
+            return true;
+        }
+
+        // Everything the upstream pushed is visible once it is seen done
+        if (upstream_workers_n.load(std::memory_order_acquire) == 0)
+        {
+            return queue.try_pop(item);
+        }
+
+        back_off(attempts_n);
+    }
+}
+
+}
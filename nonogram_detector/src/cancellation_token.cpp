@@ -0,0 +1,23 @@
+#include "cancellation_token.hpp"
+
+namespace ng
+{
+
+CancellationToken::CancellationToken()
+    : m_is_cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+
+void CancellationToken::cancel() const
+{
+    m_is_cancelled->store(true);
+}
+
+
+bool CancellationToken::is_cancelled() const
+{
+    return m_is_cancelled->load();
+}
+
+}
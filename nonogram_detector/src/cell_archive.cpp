@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+
+#include "cell_archive.hpp"
+
+namespace ng
+{
+
+namespace
+{
+
+char const CELL_ARCHIVE_MAGIC[4] = { 'N', 'G', 'C', 'A' };
+
+uint32_t const CELL_ARCHIVE_VERSION = 1;
+
+
+// The index is read with memcpy, so the layout must not have padding
+static_assert(sizeof(CellArchiveHeader) == 16, "CellArchiveHeader must be packed");
+static_assert(sizeof(CellArchiveEntry) == 32, "CellArchiveEntry must be packed");
+
+
+bool is_less(CellArchiveEntry const& entry_1, CellArchiveEntry const& entry_2)
+{
+    return
+        std::make_tuple(entry_1.area, entry_1.row, entry_1.col) <
+        std::make_tuple(entry_2.area, entry_2.row, entry_2.col);
+}
+
+}
+
+
+void CellArchiveWriter::add(CellArea const area, std::vector<std::vector<cv::Mat>> const& cell_images)
+{
+    auto const area_it = std::find_if(
+        m_areas.begin(),
+        m_areas.end(),
+        [area](std::pair<CellArea, std::vector<std::vector<cv::Mat>>> const& area_cell_images)
+        {
+            return area_cell_images.first == area;
+        });
+
+    if (area_it != m_areas.end())
+    {
+        area_it->second = cell_images;
+    }
+    else
+    {
+        m_areas.emplace_back(area, cell_images);
+    }
+}
+
+
+bool CellArchiveWriter::write(std::string const& file_path) const
+{
+    std::vector<std::pair<CellArchiveEntry, cv::Mat>> entries_cell_images;
+
+    for (auto const& area_cell_images : m_areas)
+    {
+        auto const& cell_images = area_cell_images.second;
+
+        for (size_t row = 0; row < cell_images.size(); ++row)
+        {
+            for (size_t col = 0; col < cell_images[row].size(); ++col)
+            {
+                CellArchiveEntry entry = {};
+                entry.area = area_cell_images.first;
+                entry.row = static_cast<uint32_t>(row);
+                entry.col = static_cast<uint32_t>(col);
+
+                entries_cell_images.emplace_back(entry, cell_images[row][col]);
+            }
+        }
+    }
+
+    std::sort(
+        entries_cell_images.begin(),
+        entries_cell_images.end(),
+        [](std::pair<CellArchiveEntry, cv::Mat> const& p_1, std::pair<CellArchiveEntry, cv::Mat> const& p_2)
+        {
+            return is_less(p_1.first, p_2.first);
+        });
+
+    uint64_t atlas_size = 0;
+    for (auto& entry_cell_image : entries_cell_images)
+    {
+        auto& entry = entry_cell_image.first;
+        auto const& cell_image = entry_cell_image.second;
+
+        entry.rows = cell_image.rows;
+        entry.cols = cell_image.cols;
+        entry.type = cell_image.type();
+        entry.offset = atlas_size;
+
+        atlas_size += cell_image.total() * cell_image.elemSize();
+    }
+
+    CellArchiveHeader header = {};
+    std::memcpy(header.magic, CELL_ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = CELL_ARCHIVE_VERSION;
+    header.entries_n = static_cast<uint32_t>(entries_cell_images.size());
+
+    auto const index_size = entries_cell_images.size() * sizeof(CellArchiveEntry);
+
+    // The whole archive is assembled in memory and written at once
+    std::vector<char> buffer(sizeof(header) + index_size + atlas_size);
+
+    auto buffer_p = buffer.data();
+    std::memcpy(buffer_p, &header, sizeof(header));
+    buffer_p += sizeof(header);
+
+    for (auto const& entry_cell_image : entries_cell_images)
+    {
+        std::memcpy(buffer_p, &entry_cell_image.first, sizeof(CellArchiveEntry));
+        buffer_p += sizeof(CellArchiveEntry);
+    }
+
+    for (auto const& entry_cell_image : entries_cell_images)
+    {
+        auto const& cell_image = entry_cell_image.second;
+        auto const row_size = cell_image.cols * cell_image.elemSize();
+
+        for (int y = 0; y < cell_image.rows; ++y)
+        {
+            std::memcpy(buffer_p, cell_image.ptr(y), row_size);
+            buffer_p += row_size;
+        }
+    }
+
+    std::ofstream file(file_path, std::ios::binary);
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    return static_cast<bool>(file);
+}
+
+
+CellArchiveReader::CellArchiveReader()
+    : m_atlas(nullptr)
+{
+}
+
+
+bool CellArchiveReader::open(std::string const& file_path)
+{
+    close();
+
+    if (!m_mapped_file.open(file_path))
+    {
+        return false;
+    }
+
+    auto const data = m_mapped_file.get_data();
+    auto const size = m_mapped_file.get_size();
+
+    CellArchiveHeader header;
+    if (size < sizeof(header))
+    {
+        close();
+
+        return false;
+    }
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, CELL_ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CELL_ARCHIVE_VERSION)
+    {
+        close();
+
+        return false;
+    }
+
+    auto const index_size = static_cast<uint64_t>(header.entries_n) * sizeof(CellArchiveEntry);
+    if (size - sizeof(header) < index_size)
+    {
+        close();
+
+        return false;
+    }
+
+    m_entries.resize(header.entries_n);
+    if (!m_entries.empty())
+    {
+        std::memcpy(m_entries.data(), data + sizeof(header), index_size);
+    }
+
+    m_atlas = data + sizeof(header) + index_size;
+    auto const atlas_size = size - sizeof(header) - index_size;
+
+    for (auto const& entry : m_entries)
+    {
+        // A type beyond the OpenCV types would give a wrong element size
+        if (entry.rows < 0 || entry.cols < 0 ||
+            entry.type != CV_MAT_TYPE(entry.type) || CV_MAT_DEPTH(entry.type) > CV_64F)
+        {
+            close();
+
+            return false;
+        }
+
+        auto const cell_image_size =
+            static_cast<uint64_t>(entry.rows) * entry.cols * CV_ELEM_SIZE(entry.type);
+
+        if (entry.offset > atlas_size || atlas_size - entry.offset < cell_image_size)
+        {
+            close();
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void CellArchiveReader::close()
+{
+    m_mapped_file.close();
+    m_entries.clear();
+    m_atlas = nullptr;
+}
+
+
+std::vector<CellArchiveEntry> const& CellArchiveReader::get_entries() const
+{
+    return m_entries;
+}
+
+
+cv::Mat CellArchiveReader::get_cell_image(size_t const entry_index) const
+{
+    auto const& entry = m_entries[entry_index];
+
+    // The mapping is read-only, the view must not be written to
+    return cv::Mat(entry.rows, entry.cols, entry.type, const_cast<unsigned char*>(m_atlas + entry.offset));
+}
+
+
+std::pair<bool, cv::Mat> CellArchiveReader::find_cell_image(CellArea const area, int const row, int const col) const
+{
+    CellArchiveEntry entry_key = {};
+    entry_key.area = area;
+    entry_key.row = static_cast<uint32_t>(row);
+    entry_key.col = static_cast<uint32_t>(col);
+
+    auto const entry_it = std::lower_bound(m_entries.begin(), m_entries.end(), entry_key, is_less);
+
+    if (entry_it == m_entries.end() || is_less(entry_key, *entry_it))
+    {
+        return std::make_pair(false, cv::Mat());
+    }
+
+    return std::make_pair(true, get_cell_image(static_cast<size_t>(entry_it - m_entries.begin())));
+}
+
+}
@@ -1,14 +1,20 @@
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <functional>
 #include <iterator>
+#include <limits>
 #include <numeric>
 #include <set>
+#include <thread>
 #include <tuple>
 #include <queue>
 
+#include "allocation_tracking.hpp"
 #include "cross_locs_detector.hpp"
 #include "image_operations.hpp"
 #include "masks.hpp"
+#include "tracing.hpp"
 
 namespace ng
 {
@@ -20,6 +26,19 @@ cv::Point const CrossLocsDetector::INDICES_DELTA_LEFT(-1, 0);
 
 std::vector<cv::Point> const CrossLocsDetector::INDICES_DELTAS = { INDICES_DELTA_UP, INDICES_DELTA_RIGHT, INDICES_DELTA_DOWN, INDICES_DELTA_LEFT };
 
+int const CrossLocsDetector::LATTICE_MODEL_INDICES_RADIUS = 2;
+int const CrossLocsDetector::LATTICE_MODEL_POINTS_MIN = 4;
+double const CrossLocsDetector::LATTICE_MODEL_RESIDUAL_FACTOR = 3.0;
+int const CrossLocsDetector::LATTICE_MODEL_SEARCH_RADIUS_MIN = 2;
+
+int const CrossLocsDetector::CELL_SIDE_LENGTH_COARSE_MIN = 5;
+
+float const CrossLocsDetector::CELL_PITCH_SCALE_MAX = 2.0f;
+float const CrossLocsDetector::CELL_PITCH_TOLERANCE_RATIO = 0.25f;
+
+int const CrossLocsDetector::THICK_LINES_STRIDE = 5;
+double const CrossLocsDetector::THICK_LINE_WIDTH_RATIO_MIN = 1.5;
+
 
 CrossLocsDetector::CrossLocsDetector(
     float const resize_width_height_max,
@@ -27,115 +46,437 @@ CrossLocsDetector::CrossLocsDetector(
     double const threshold_c,
     int const find_cell_side_length_min,
     int const find_cell_side_length_max,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    DetectionOptions const& options)
     : M_RESIZE_WIDTH_HEIGHT_MAX(resize_width_height_max)
     , M_THRESHOLD_BLOCK_SIZE(threshold_block_size)
     , M_THRESHOLD_C(threshold_c)
     , M_FIND_CELL_SIDE_LENGTH_MIN(find_cell_side_length_min)
     , M_FIND_CELL_SIDE_LENGTH_MAX(find_cell_side_length_max)
     , M_SIMILARITY_RATIO_MIN(similarity_ratio_min)
+    , M_OPTIONS(options)
+{
+}
+
+
+CrossLocsDetector::CrossLocsDetector(
+    ThresholdProfile const& threshold_profile,
+    int const find_cell_side_length_min,
+    int const find_cell_side_length_max,
+    double const similarity_ratio_min,
+    DetectionOptions const& options)
+    : CrossLocsDetector(
+        threshold_profile.resize_width_height_max,
+        threshold_profile.threshold_block_size,
+        threshold_profile.threshold_c,
+        find_cell_side_length_min,
+        find_cell_side_length_max,
+        similarity_ratio_min,
+        options)
 {
 }
 
 
-std::tuple<bool, cv::Mat, cv::Mat, cv::Mat> CrossLocsDetector::detect(cv::Mat const& image)
+std::tuple<bool, cv::Mat, cv::Mat, cv::Mat> CrossLocsDetector::detect(cv::Mat const& image) const
 {
-    cv::Mat image_resized;
-    float scale;
-    std::tie(image_resized, scale) = resize(image, M_RESIZE_WIDTH_HEIGHT_MAX);
+    auto const detection_result = detect(image, Deadline());
 
-    //std::cout << "scale: " << scale << std::endl;
+    return std::make_tuple(
+        detection_result.is_found,
+        detection_result.cross_locs_main_mat,
+        detection_result.cross_locs_top_mat,
+        detection_result.cross_locs_left_mat);
+}
 
-    cv::Mat image_gray;
-    cv::cvtColor(image_resized, image_gray, cv::COLOR_BGR2GRAY);
 
-    auto const image_thresholded =
-        threshold(image_gray, M_THRESHOLD_BLOCK_SIZE, M_THRESHOLD_C);
+DetectionResult CrossLocsDetector::detect(cv::Mat const& image, Deadline const& deadline) const
+{
+    return detect(image, DetectionHints(), deadline);
+}
+
+
+DetectionResult CrossLocsDetector::detect(
+    cv::Mat const& image,
+    DetectionHints const& hints,
+    Deadline const& deadline) const
+{
+    DetectionWorkspace workspace;
+
+    return detect(image, hints, deadline, workspace);
+}
+
 
+DetectionResult CrossLocsDetector::detect(
+    cv::Mat const& image,
+    DetectionHints const& hints,
+    Deadline const& deadline,
+    DetectionWorkspace& workspace) const
+{
+    NG_TRACE_SPAN(trace_span, "detect");
+    NG_TRACE_ARG(trace_span, "width", image.cols);
+    NG_TRACE_ARG(trace_span, "height", image.rows);
+
+    AllocationScope allocation_scope;
+
+    // The quad is in the coordinates of the original image
+    auto hints_input = hints;
+    for (auto& corner : hints_input.quad)
     {
-        auto image_thresholded_copy = image_thresholded.clone();
-        image_thresholded_copy *= 255;
+        corner *= hints.input_scale;
+    }
+
+    auto image_crop_roi = get_crop_roi(image.size(), hints_input);
+
+    if (hints_input.quad.empty() && M_OPTIONS.localize_page)
+    {
+        bool grid_roi_found;
+        cv::Rect grid_roi;
+        std::tie(grid_roi_found, grid_roi) = localize_grid(
+            image,
+            M_OPTIONS.localization_width_height_max,
+            M_OPTIONS.localization_margin_ratio);
+
+        if (grid_roi_found)
+        {
+            image_crop_roi = grid_roi;
+        }
+    }
+
+    // The crop gets the scale of the whole image, so the cell side lengths stay in the searched range
+
+    auto const width_height_max = static_cast<float>(std::max(image.rows, image.cols));
+    auto scale = M_RESIZE_WIDTH_HEIGHT_MAX / width_height_max;
+
+    auto find_cell_side_length_min = M_FIND_CELL_SIDE_LENGTH_MIN;
+    auto find_cell_side_length_max = M_FIND_CELL_SIDE_LENGTH_MAX;
+
+    if (M_OPTIONS.cell_pitch_target > 0)
+    {
+        bool cell_pitch_found;
+        float cell_pitch;
+        std::tie(cell_pitch_found, cell_pitch) = estimate_cell_pitch(
+            image(image_crop_roi),
+            M_OPTIONS.pitch_estimation_width_height_max);
+
+        if (cell_pitch_found)
+        {
+            scale = std::min(M_OPTIONS.cell_pitch_target / cell_pitch, CELL_PITCH_SCALE_MAX);
+
+            // The cells of a small pitch stay below the target once the scale is capped
+            auto const cell_pitch_resized = static_cast<int>(std::round(cell_pitch * scale));
+            auto const cell_side_length_delta =
+                static_cast<int>(std::ceil(CELL_PITCH_TOLERANCE_RATIO * cell_pitch_resized));
+
+            find_cell_side_length_min = std::max(cell_pitch_resized - cell_side_length_delta, 3);
+            find_cell_side_length_max = cell_pitch_resized + cell_side_length_delta;
+        }
+    }
+
+    auto& image_resized = workspace.image_resized;
+    cv::resize(image(image_crop_roi), image_resized, cv::Size(), scale, scale, cv::INTER_LINEAR);
+
+    cv::Size const main_grid_size(hints.main_grid_cols, hints.main_grid_rows);
+
+    //std::cout << "scale: " << scale << std::endl;
+
+    // A reduced JPEG decode may already be gray
+    auto& image_gray = workspace.image_gray;
+    if (image_resized.channels() == 3)
+    {
+        cv::cvtColor(image_resized, image_gray, cv::COLOR_BGR2GRAY);
+    }
+    else
+    {
+        image_gray = image_resized;
+    }
+
+    auto& image_thresholded = workspace.image_thresholded;
+    threshold(image_gray, M_THRESHOLD_BLOCK_SIZE, M_THRESHOLD_C, image_thresholded);
+
+    // Maps the grids through the input image to the original one
+    auto detection_result = detect_grids(
+        image_gray,
+        image_thresholded,
+        scale * hints.input_scale,
+        cv::Point2f(image_crop_roi.tl()) / hints.input_scale,
+        find_cell_side_length_min,
+        find_cell_side_length_max,
+        main_grid_size,
+        deadline);
+
+    detection_result.allocations = allocation_scope.get_stats();
+
+    return detection_result;
+}
+
+
+DetectionResult CrossLocsDetector::detect_thresholded(
+    cv::Mat const& image_gray,
+    cv::Mat const& image_thresholded,
+    float const scale,
+    cv::Point const& offset,
+    DetectionHints const& hints,
+    Deadline const& deadline) const
+{
+    AllocationScope allocation_scope;
+
+    auto detection_result = detect_grids(
+        image_gray,
+        image_thresholded,
+        scale,
+        offset,
+        M_FIND_CELL_SIDE_LENGTH_MIN,
+        M_FIND_CELL_SIDE_LENGTH_MAX,
+        cv::Size(hints.main_grid_cols, hints.main_grid_rows),
+        deadline);
+
+    detection_result.allocations = allocation_scope.get_stats();
+
+    return detection_result;
+}
 
-        //cv::resize(image_thresholded_copy, image_thresholded_copy, {}, 0.55, 0.55);
 
+DetectionResult CrossLocsDetector::detect_grids(
+    cv::Mat const& image_gray,
+    cv::Mat const& image_thresholded,
+    float const scale,
+    cv::Point2f const& offset,
+    int const find_cell_side_length_min,
+    int const find_cell_side_length_max,
+    cv::Size const main_grid_size,
+    Deadline const& deadline) const
+{
+    NG_TRACE_SPAN(trace_span, "detect_grids");
 
-        cv::imshow("image_thresholded", image_thresholded_copy);
-        cv::waitKey(0);
+    DetectionResult detection_result;
+
+    // In the pyramid mode the seed and the lattice are searched on a coarse level
+    // and only refined on <image_thresholded>
+    auto const pyramid_factor = 1 << M_OPTIONS.pyramid_levels;
+
+    cv::Mat image_search_thresholded = image_thresholded;
+    if (pyramid_factor > 1)
+    {
+        cv::Mat image_gray_coarse;
+        cv::resize(
+            image_gray,
+            image_gray_coarse,
+            cv::Size(),
+            1.0 / pyramid_factor,
+            1.0 / pyramid_factor,
+            cv::INTER_AREA);
+
+        auto const threshold_block_size_coarse =
+            std::max(3, M_THRESHOLD_BLOCK_SIZE / pyramid_factor / 2 * 2 + 1);
+
+        image_search_thresholded =
+            threshold(image_gray_coarse, threshold_block_size_coarse, M_THRESHOLD_C);
     }
 
     bool cell_loc_found;
     int cell_side_length;
     cv::Point cell_loc;
     {
-        cv::Point const image_center(image_thresholded.size() / 2);
-        auto const cell_loc_roi = get_roi(image_center, { 150, 150 });
+        auto const cell_side_length_min =
+            std::max(find_cell_side_length_min / pyramid_factor, CELL_SIDE_LENGTH_COARSE_MIN);
+        auto const cell_side_length_max =
+            std::max(find_cell_side_length_max / pyramid_factor, cell_side_length_min);
+
+        auto const cell_loc_roi_side_length = std::max(150 / pyramid_factor, 2 * cell_side_length_max + 1);
 
         std::tie(cell_loc_found, cell_side_length, cell_loc) =
-            find_cell_side_length_cell_loc(
-                image_thresholded,
-                cell_loc_roi,
-                M_FIND_CELL_SIDE_LENGTH_MIN,
-                M_FIND_CELL_SIDE_LENGTH_MAX,
-                M_SIMILARITY_RATIO_MIN);
+            find_seed(
+                image_search_thresholded,
+                cell_loc_roi_side_length,
+                cell_side_length_min,
+                cell_side_length_max,
+                M_SIMILARITY_RATIO_MIN,
+                M_OPTIONS,
+                deadline);
     }
 
+    detection_result.seed.is_completed = cell_loc_found || !deadline.is_expired();
+    detection_result.seed.found_n = cell_loc_found ? 1 : 0;
+
     if (!cell_loc_found)
     {
-        return std::make_tuple(false, cv::Mat(), cv::Mat(), cv::Mat());
+        detection_result.is_partial = !detection_result.seed.is_completed;
+
+        return detection_result;
     }
 
-    std::cout << (cell_loc_found ? "Cell is detected" : "Cell is not detected") << std::endl;
-    std::cout << "cell_side_length: " << cell_side_length << std::endl;
-    std::cout << "cell_loc: " << cell_loc << std::endl;
+    detection_result.is_found = true;
+    detection_result.scale = scale;
+    detection_result.cell_pitch = cell_side_length * pyramid_factor / scale;
 
-    auto cross_locs_main_mat = get_cross_locs_main_mat(
-        image_thresholded,
+    auto& cross_locs_main_mat = detection_result.cross_locs_main_mat;
+    auto& cross_locs_top_mat = detection_result.cross_locs_top_mat;
+    auto& cross_locs_left_mat = detection_result.cross_locs_left_mat;
+
+    // Every stage runs only if the previous one completed in time
+    int main_grid_found_n;
+    int main_grid_holes_n;
+    std::tie(cross_locs_main_mat, main_grid_found_n, main_grid_holes_n) = get_cross_locs_main_mat(
+        image_search_thresholded,
         cell_loc,
         cell_side_length,
-        M_SIMILARITY_RATIO_MIN);
+        M_SIMILARITY_RATIO_MIN,
+        M_OPTIONS,
+        main_grid_size,
+        deadline);
 
-    cv::Mat cross_locs_main_rescaled_mat = cross_locs_main_mat / scale;
+    detection_result.main_grid = get_stage_progress(main_grid_found_n, !deadline.is_expired());
+    detection_result.main_grid.holes_n = main_grid_holes_n;
 
-    auto cross_locs_top_mat = get_cross_locs_top_mat(
-        image_thresholded,
-        cross_locs_main_mat,
-        cell_side_length,
-        M_SIMILARITY_RATIO_MIN);
+    auto const find_cross_locs_top_mat = [&]()
+    {
+        int top_grid_found_n;
+        std::tie(cross_locs_top_mat, top_grid_found_n) = get_cross_locs_top_mat(
+            image_search_thresholded,
+            cross_locs_main_mat,
+            cell_side_length,
+            M_SIMILARITY_RATIO_MIN,
+            M_OPTIONS,
+            main_grid_size,
+            deadline);
+
+        detection_result.top_grid = get_stage_progress(top_grid_found_n, !deadline.is_expired());
+    };
+
+    auto const find_cross_locs_left_mat = [&]()
+    {
+        int left_grid_found_n;
+        std::tie(cross_locs_left_mat, left_grid_found_n) = get_cross_locs_left_mat(
+            image_search_thresholded,
+            cross_locs_main_mat,
+            cell_side_length,
+            M_SIMILARITY_RATIO_MIN,
+            M_OPTIONS,
+            main_grid_size,
+            deadline);
+
+        detection_result.left_grid = get_stage_progress(left_grid_found_n, !deadline.is_expired());
+    };
+
+    if (detection_result.main_grid.is_completed)
+    {
+        // The top and the left grids depend on the main grid only
+        if (M_OPTIONS.scheduler)
+        {
+            run_stages({ find_cross_locs_top_mat, find_cross_locs_left_mat }, M_OPTIONS);
+        }
+        else
+        {
+            find_cross_locs_top_mat();
 
-    cv::Mat cross_locs_top_rescaled_mat = cross_locs_top_mat / scale;
+            if (detection_result.top_grid.is_completed)
+            {
+                find_cross_locs_left_mat();
+            }
+        }
+    }
 
-    auto cross_locs_left_mat = get_cross_locs_left_mat(
-        image_thresholded,
-        cross_locs_main_mat,
-        cell_side_length,
-        M_SIMILARITY_RATIO_MIN);
+    detection_result.is_partial = !detection_result.top_grid.is_completed || !detection_result.left_grid.is_completed;
 
-    cv::Mat cross_locs_left_rescaled_mat = cross_locs_left_mat / scale;
+    if (pyramid_factor > 1)
+    {
+        auto const cell_side_length_fine = cell_side_length * pyramid_factor;
 
-    return std::make_tuple(
-        true,
-        cross_locs_main_rescaled_mat,
-        cross_locs_top_rescaled_mat,
-        cross_locs_left_rescaled_mat);
+        cv::Mat mask_cross_main;
+        int mask_cross_main_perimeter;
+        std::tie(mask_cross_main, mask_cross_main_perimeter) = get_mask_cross_main(cell_side_length_fine);
+
+        cv::Mat mask_cross_clues;
+        int mask_cross_clues_perimeter;
+        std::tie(mask_cross_clues, mask_cross_clues_perimeter) = get_mask_cross_clues(cell_side_length_fine);
+
+        run_stages(
+            {
+                [&]()
+                {
+                    bool is_refined;
+                    std::tie(cross_locs_main_mat, is_refined) = refine(
+                        image_thresholded,
+                        cross_locs_main_mat,
+                        pyramid_factor,
+                        mask_cross_main,
+                        mask_cross_main_perimeter,
+                        M_SIMILARITY_RATIO_MIN,
+                        deadline);
+
+                    detection_result.main_grid.is_completed = detection_result.main_grid.is_completed && is_refined;
+                },
+                [&]()
+                {
+                    bool is_refined;
+                    std::tie(cross_locs_top_mat, is_refined) = refine(
+                        image_thresholded,
+                        cross_locs_top_mat,
+                        pyramid_factor,
+                        mask_cross_clues,
+                        mask_cross_clues_perimeter,
+                        M_SIMILARITY_RATIO_MIN,
+                        deadline);
+
+                    detection_result.top_grid.is_completed = detection_result.top_grid.is_completed && is_refined;
+                },
+                [&]()
+                {
+                    bool is_refined;
+                    std::tie(cross_locs_left_mat, is_refined) = refine(
+                        image_thresholded,
+                        cross_locs_left_mat,
+                        pyramid_factor,
+                        mask_cross_clues,
+                        mask_cross_clues_perimeter,
+                        M_SIMILARITY_RATIO_MIN,
+                        deadline);
+
+                    detection_result.left_grid.is_completed = detection_result.left_grid.is_completed && is_refined;
+                }
+            },
+            M_OPTIONS);
+
+        // The refinement stops on the deadline as well, the grids left upscaled only are partial
+        detection_result.is_partial =
+            !detection_result.main_grid.is_completed ||
+            !detection_result.top_grid.is_completed ||
+            !detection_result.left_grid.is_completed;
+    }
+
+    cross_locs_main_mat = rescale(cross_locs_main_mat, scale, offset);
+    cross_locs_top_mat = rescale(cross_locs_top_mat, scale, offset);
+    cross_locs_left_mat = rescale(cross_locs_left_mat, scale, offset);
+
+    return detection_result;
 }
 
 
-std::tuple<bool, int, cv::Point> CrossLocsDetector::find_cell_side_length_cell_loc(
+std::tuple<bool, int, cv::Point, double> CrossLocsDetector::find_cell_side_length_cell_loc(
     cv::Mat const& image_thresholded,
     cv::Rect const& image_thresholded_roi,
     int const cell_side_length_min,
     int const cell_side_length_max,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    Deadline const& deadline)
 {
+    NG_TRACE_SPAN(trace_span, "find_cell_side_length_cell_loc");
+
     for (auto cell_side_length = cell_side_length_min; cell_side_length <= cell_side_length_max; ++cell_side_length)
     {
+        if (deadline.is_expired())
+        {
+            break;
+        }
+
         cv::Mat mask_square;
         int mask_square_perimeter;
         std::tie(mask_square, mask_square_perimeter) = get_mask_square(cell_side_length);
 
         bool cell_loc_found;
         cv::Point cell_loc;
-        std::tie(cell_loc_found, cell_loc) = find_kernel_loc(
+        double cell_loc_score;
+        std::tie(cell_loc_found, cell_loc, cell_loc_score) = find_kernel_loc_peak(
             image_thresholded,
             image_thresholded_roi,
             mask_square,
@@ -145,11 +486,243 @@ std::tuple<bool, int, cv::Point> CrossLocsDetector::find_cell_side_length_cell_l
 
         if (cell_loc_found)
         {
-            return std::make_tuple(true, cell_side_length, cell_loc);
+            return std::make_tuple(true, cell_side_length, cell_loc, cell_loc_score);
+        }
+    }
+
+    return std::make_tuple(false, -1, cv::Point(-1, -1), 0.0);
+}
+
+
+std::tuple<bool, int, cv::Point> CrossLocsDetector::find_seed(
+    cv::Mat const& image_thresholded,
+    int const roi_side_length,
+    int const cell_side_length_min,
+    int const cell_side_length_max,
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    Deadline const& deadline)
+{
+    NG_TRACE_SPAN(trace_span, "find_seed");
+
+    auto const tiles_n = std::max(options.seed_search_tiles, 1);
+
+    cv::Point const image_center(image_thresholded.size() / 2);
+    cv::Rect const image_roi(cv::Point(0, 0), image_thresholded.size());
+
+    std::vector<cv::Point> tile_centers;
+    for (int i = 0; i < tiles_n; ++i)
+    {
+        for (int j = 0; j < tiles_n; ++j)
+        {
+            tile_centers.push_back(cv::Point(
+                (2 * j + 1) * image_thresholded.cols / (2 * tiles_n),
+                (2 * i + 1) * image_thresholded.rows / (2 * tiles_n)));
+        }
+    }
+
+    std::stable_sort(
+        tile_centers.begin(),
+        tile_centers.end(),
+        [&image_center](cv::Point const& tile_center_1, cv::Point const& tile_center_2)
+        {
+            auto const delta_1 = tile_center_1 - image_center;
+            auto const delta_2 = tile_center_2 - image_center;
+
+            return delta_1.dot(delta_1) < delta_2.dot(delta_2);
+        });
+
+    std::vector<std::tuple<bool, int, cv::Point, double>> tile_results(
+        tile_centers.size(),
+        std::make_tuple(false, -1, cv::Point(-1, -1), 0.0));
+
+    // A confident seed cancels the rest of the tiles
+    CancellationToken tiles_cancellation_token;
+    auto const tiles_deadline = deadline.with_cancellation_token(tiles_cancellation_token);
+
+    std::atomic<int> tile_index_next(0);
+
+    auto const search_tiles = [&]()
+    {
+        for (int tile_index = tile_index_next++; tile_index < tile_centers.size(); tile_index = tile_index_next++)
+        {
+            if (tiles_deadline.is_expired())
+            {
+                return;
+            }
+
+            auto const tile_roi =
+                get_roi(tile_centers[tile_index], { roi_side_length, roi_side_length }) & image_roi;
+
+            auto const tile_result = find_cell_side_length_cell_loc(
+                image_thresholded,
+                tile_roi,
+                cell_side_length_min,
+                cell_side_length_max,
+                similarity_ratio_min,
+                tiles_deadline);
+
+            tile_results[tile_index] = tile_result;
+
+            if (std::get<0>(tile_result) && std::get<3>(tile_result) >= options.seed_similarity_ratio_confident)
+            {
+                tiles_cancellation_token.cancel();
+            }
+        }
+    };
+
+    // The tiles searched on the other threads are charged to the detection
+    auto const allocation_account = get_allocation_account();
+
+    if (options.scheduler)
+    {
+        auto const threads_n = std::min(
+            static_cast<int>(tile_centers.size()),
+            options.scheduler->get_workers_n() + 1);
+
+        options.scheduler->parallel_for(
+            threads_n,
+            [&search_tiles, allocation_account](int)
+            {
+                AllocationAccountBinding allocation_account_binding(allocation_account);
+                search_tiles();
+            });
+    }
+    else
+    {
+        auto const threads_n = std::min(
+            static_cast<int>(tile_centers.size()),
+            std::max(static_cast<int>(std::thread::hardware_concurrency()), 1));
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < threads_n; ++i)
+        {
+            threads.emplace_back(
+                [&search_tiles, allocation_account]()
+                {
+                    AllocationAccountBinding allocation_account_binding(allocation_account);
+                    search_tiles();
+                });
+        }
+
+        search_tiles();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    auto const tile_result_best_it = std::max_element(
+        tile_results.begin(),
+        tile_results.end(),
+        [](std::tuple<bool, int, cv::Point, double> const& tile_result_1, std::tuple<bool, int, cv::Point, double> const& tile_result_2)
+        {
+            auto const score_1 = std::get<0>(tile_result_1) ? std::get<3>(tile_result_1) : -1.0;
+            auto const score_2 = std::get<0>(tile_result_2) ? std::get<3>(tile_result_2) : -1.0;
+
+            return score_1 < score_2;
+        });
+
+    return std::make_tuple(
+        std::get<0>(*tile_result_best_it),
+        std::get<1>(*tile_result_best_it),
+        std::get<2>(*tile_result_best_it));
+}
+
+
+std::tuple<bool, cv::Point, double> CrossLocsDetector::predict_cross_loc(
+    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map,
+    cv::Point const& indices,
+    int const indices_radius)
+{
+    // (indices delta, cross location) of the found neighbors
+    thread_local std::vector<std::pair<cv::Point, cv::Point>> neighbors;
+    neighbors.clear();
+
+    cv::Point deltas_min(indices_radius, indices_radius);
+    cv::Point deltas_max(-indices_radius, -indices_radius);
+
+    for (auto dy = -indices_radius; dy <= indices_radius; ++dy)
+    {
+        for (auto dx = -indices_radius; dx <= indices_radius; ++dx)
+        {
+            auto const indices_cross_loc_it = cross_locs_map.find(indices + cv::Point(dx, dy));
+            if (indices_cross_loc_it != cross_locs_map.end())
+            {
+                neighbors.emplace_back(cv::Point(dx, dy), indices_cross_loc_it->second);
+
+                deltas_min = cv::Point(std::min(deltas_min.x, dx), std::min(deltas_min.y, dy));
+                deltas_max = cv::Point(std::max(deltas_max.x, dx), std::max(deltas_max.y, dy));
+            }
         }
     }
 
-    return std::make_tuple(false, -1, cv::Point(-1, -1));
+    // The model is degenerate if all the crosses lie on one line of the lattice
+    if (static_cast<int>(neighbors.size()) < LATTICE_MODEL_POINTS_MIN ||
+        deltas_min.x == deltas_max.x ||
+        deltas_min.y == deltas_max.y)
+    {
+        return std::make_tuple(false, cv::Point(-1, -1), 0.0);
+    }
+
+    // Normal equations of the least squares fit of (dx, dy, 1) -> (x, y).
+    // The deltas are relative to <indices>, so the prediction is the constant term
+    double sxx = 0.0, sxy = 0.0, sx = 0.0, syy = 0.0, sy = 0.0;
+    cv::Point2d sxp;
+    cv::Point2d syp;
+    cv::Point2d sp;
+    for (auto const& neighbor : neighbors)
+    {
+        auto const& delta = neighbor.first;
+        cv::Point2d const cross_loc = neighbor.second;
+
+        sxx += delta.x * delta.x;
+        sxy += delta.x * delta.y;
+        sx += delta.x;
+        syy += delta.y * delta.y;
+        sy += delta.y;
+        sxp += delta.x * cross_loc;
+        syp += delta.y * cross_loc;
+        sp += cross_loc;
+    }
+
+    double const n = static_cast<double>(neighbors.size());
+
+    // Cramer's rule over [[sxx, sxy, sx], [sxy, syy, sy], [sx, sy, n]]
+    auto const cofactor_xx = syy * n - sy * sy;
+    auto const cofactor_xy = sy * sx - sxy * n;
+    auto const cofactor_x = sxy * sy - syy * sx;
+    auto const determinant = sxx * cofactor_xx + sxy * cofactor_xy + sx * cofactor_x;
+
+    if (std::abs(determinant) < 1e-9)
+    {
+        return std::make_tuple(false, cv::Point(-1, -1), 0.0);
+    }
+
+    auto const cofactor_yy = sxx * n - sx * sx;
+    auto const cofactor_y = sx * sxy - sxx * sy;
+    auto const cofactor_1 = sxx * syy - sxy * sxy;
+
+    // The inverse is symmetric, its rows are the cofactors over the determinant
+    auto const a = (cofactor_xx * sxp + cofactor_xy * syp + cofactor_x * sp) / determinant;
+    auto const b = (cofactor_xy * sxp + cofactor_yy * syp + cofactor_y * sp) / determinant;
+    auto const c = (cofactor_x * sxp + cofactor_y * syp + cofactor_1 * sp) / determinant;
+
+    double residual_max = 0.0;
+    for (auto const& neighbor : neighbors)
+    {
+        auto const& delta = neighbor.first;
+        auto const residual = a * delta.x + b * delta.y + c - cv::Point2d(neighbor.second);
+
+        residual_max = std::max(residual_max, std::hypot(residual.x, residual.y));
+    }
+
+    cv::Point const cross_loc_predicted(
+        static_cast<int>(std::round(c.x)),
+        static_cast<int>(std::round(c.y)));
+
+    return std::make_tuple(true, cross_loc_predicted, residual_max);
 }
 
 
@@ -157,13 +730,21 @@ std::map<cv::Point, cv::Point, PointCompare> CrossLocsDetector::get_cross_locs_m
     cv::Mat const& image_thresholded,
     std::vector<cv::Point> const& indices_init,
     std::vector<cv::Point> const& cross_locs_init,
+    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_known_map,
     std::vector<cv::Point> const& indices_deltas,
     std::vector<cv::Point> const& cross_loc_deltas,
     cv::Size const roi_size,
     cv::Mat const& mask_cross,
     int const mask_cross_perimeter,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    cv::Size const indices_span_max,
+    bool const predict_from_lattice_model,
+    Deadline const& deadline)
 {
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_map");
+    NG_TRACE_ARG(trace_span, "roi_width", roi_size.width);
+    NG_TRACE_ARG(trace_span, "roi_height", roi_size.height);
+
     std::queue<cv::Point> indices_queue;
     std::set<cv::Point, PointCompare> was_in_indices_queue_set;
     for (auto const& indices_init : indices_init)
@@ -184,250 +765,798 @@ std::map<cv::Point, cv::Point, PointCompare> CrossLocsDetector::get_cross_locs_m
 
     std::map<cv::Point, cv::Point, PointCompare> cross_locs_map;
 
-    while (!indices_queue.empty())
+    // Bounds of the found indices
+    cv::Point indices_found_min(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+    cv::Point indices_found_max(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+
+    auto const is_within_span = [&](cv::Point const& indices)
+    {
+        auto const span_x = std::max(indices_found_max.x, indices.x) - std::min(indices_found_min.x, indices.x);
+        auto const span_y = std::max(indices_found_max.y, indices.y) - std::min(indices_found_min.y, indices.y);
+
+        return
+            (indices_span_max.width <= 0 || span_x <= indices_span_max.width) &&
+            (indices_span_max.height <= 0 || span_y <= indices_span_max.height);
+    };
+
+    // Stores the found cross and queues its neighbors
+    auto const add_cross_loc = [&](cv::Point const& indices, cv::Point const& cross_loc)
+    {
+        cross_locs_map[indices] = cross_loc;
+
+        indices_found_min = cv::Point(std::min(indices_found_min.x, indices.x), std::min(indices_found_min.y, indices.y));
+        indices_found_max = cv::Point(std::max(indices_found_max.x, indices.x), std::max(indices_found_max.y, indices.y));
+
+        for (int i = 0; i < indices_deltas.size(); ++i)
+        {
+            auto const indices_neighbor = indices + indices_deltas[i];
+            bool const was_in_indices_queue =
+                was_in_indices_queue_set.find(indices_neighbor) != was_in_indices_queue_set.end();
+
+            // The expected extent of the grid is reached, do not probe beyond it
+            if (!was_in_indices_queue && is_within_span(indices_neighbor))
+            {
+                indices_queue.push(indices_neighbor);
+                was_in_indices_queue_set.insert(indices_neighbor);
+
+                auto const cross_loc_neighbor_init = cross_loc + cross_loc_deltas[i];
+                cross_locs_init_map[indices_neighbor] = cross_loc_neighbor_init;
+            }
+        }
+    };
+
+    // The known crosses are not searched again, only their neighbors are
+    for (auto const& indices_cross_loc_known : cross_locs_known_map)
+    {
+        was_in_indices_queue_set.insert(indices_cross_loc_known.first);
+    }
+
+    for (auto const& indices_cross_loc_known : cross_locs_known_map)
+    {
+        add_cross_loc(indices_cross_loc_known.first, indices_cross_loc_known.second);
+    }
+
+    while (!indices_queue.empty() && !deadline.is_expired())
     {
         auto const indices = indices_queue.front();
         indices_queue.pop();
 
         auto const& cross_loc_init = cross_locs_init_map[indices];
 
+        bool cross_loc_found = false;
+        cv::Point cross_loc;
+
+        // Under perspective a fixed delta drifts, so predict from the already found neighbors
+        // and search only as far as the model residual requires
+        bool cross_loc_predicted_found = false;
+        cv::Point cross_loc_predicted;
+        double residual;
+
+        if (predict_from_lattice_model)
+        {
+            std::tie(cross_loc_predicted_found, cross_loc_predicted, residual) =
+                predict_cross_loc(cross_locs_map, indices, LATTICE_MODEL_INDICES_RADIUS);
+        }
+
+        if (cross_loc_predicted_found)
+        {
+            // The window covers the mask and the model error, it is independent of the cell size
+            auto const search_radius = std::max(
+                static_cast<int>(std::ceil(LATTICE_MODEL_RESIDUAL_FACTOR * residual)),
+                LATTICE_MODEL_SEARCH_RADIUS_MIN);
+
+            cv::Size const roi_predicted_size(
+                std::min(roi_size.width, mask_cross.cols + 2 * search_radius),
+                std::min(roi_size.height, mask_cross.rows + 2 * search_radius));
+
+            std::tie(cross_loc_found, cross_loc) = find_kernel_loc(
+                image_thresholded,
+                get_roi(cross_loc_predicted, roi_predicted_size),
+                mask_cross,
+                mask_cross_perimeter,
+                similarity_ratio_min);
+        }
+
+        // The full window is searched without a model (the first steps from the seed) and on a miss of the model,
+        // as the probed index lies a step beyond the fitted neighbors and the page may bend there
+        if (!cross_loc_found)
+        {
+            std::tie(cross_loc_found, cross_loc) = find_kernel_loc(
+                image_thresholded,
+                get_roi(cross_loc_init, roi_size),
+                mask_cross,
+                mask_cross_perimeter,
+                similarity_ratio_min);
+        }
+
+        if (cross_loc_found && is_within_span(indices))
+        {
+            //// Draw
+            //{
+            //    cv::circle(image_thresholded_copy, cross_loc, 5, 255, -1);
+            //    cv::circle(image_thresholded_copy, cross_loc, 3, 0, -1);
+
+            //    cv::imshow("image_thresholded_copy", image_thresholded_copy);
+            //    cv::waitKey(1);
+            //}
+
+            add_cross_loc(indices, cross_loc);
+        }
+    }
+
+    NG_TRACE_ARG(trace_span, "found_n", cross_locs_map.size());
+
+    return cross_locs_map;
+}
+
+
+cv::Rect CrossLocsDetector::get_bounding_rectangle(
+    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map)
+{
+    auto const x_min_max_it = std::minmax_element(
+        cross_locs_map.cbegin(),
+        cross_locs_map.cend(),
+        [](std::pair<cv::Point, cv::Point> const& p_1, std::pair<cv::Point, cv::Point> const& p_2)
+        {
+            auto const& x_1 = p_1.first.x;
+            auto const& x_2 = p_2.first.x;
+
+            return x_1 < x_2;
+        });
+
+    auto const y_min_max_it = std::minmax_element(
+        cross_locs_map.cbegin(),
+        cross_locs_map.cend(),
+        [](std::pair<cv::Point, cv::Point> const& p_1, std::pair<cv::Point, cv::Point> const& p_2)
+        {
+            auto const& y_1 = p_1.first.y;
+            auto const& y_2 = p_2.first.y;
+
+            return y_1 < y_2;
+        });
+
+    cv::Rect const bounding_rectangle(
+        cv::Point(x_min_max_it.first->first.x, y_min_max_it.first->first.y),
+        cv::Point(x_min_max_it.second->first.x, y_min_max_it.second->first.y));
+
+    return bounding_rectangle;
+}
+
+
+cv::Mat CrossLocsDetector::convert_to_mat(
+    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map)
+{
+    if (cross_locs_map.empty())
+    {
+        return cv::Mat();
+    }
+
+    auto const bounding_rectangle = get_bounding_rectangle(cross_locs_map);
+    auto const cross_loc_mat_size = bounding_rectangle.size() + cv::Size(1, 1);
+
+    cv::Mat cross_locs_mat(cross_loc_mat_size, CV_32SC2, cv::Scalar(-1, -1));
+
+    for (auto x_map = bounding_rectangle.tl().x, x_mat = 0; x_map <= bounding_rectangle.br().x; ++x_map, ++x_mat)
+    {
+        for (auto y_map = bounding_rectangle.tl().y, y_mat = 0; y_map <= bounding_rectangle.br().y; ++y_map, ++y_mat)
+        {
+            cv::Point indices_map(x_map, y_map);
+            cv::Point indices_mat(x_mat, y_mat);
+
+            auto const indices_cross_loc_it = cross_locs_map.find(indices_map);
+            if (indices_cross_loc_it != cross_locs_map.end())
+            {
+                cross_locs_mat.at<cv::Point>(indices_mat) = indices_cross_loc_it->second;
+            }
+        }
+    }
+
+    return cross_locs_mat;
+}
+
+
+cv::Mat CrossLocsDetector::augment(
+    cv::Mat image_resized,
+    cv::Mat const& cross_locs_mat,
+    int const cell_side_length)
+{
+    NG_TRACE_SPAN(trace_span, "augment");
+
+    cv::Mat cross_locs_mat_augmented = cross_locs_mat.clone();
+
+    // Distance in lattice steps to the nearest detected cross, -1 if not reached yet.
+    // A hole is interpolated only from the neighbors closer to the detected crosses,
+    // so filling in the breadth-first order gives the same result as filling round by round
+    cv::Mat distances(cross_locs_mat.size(), CV_32S, cv::Scalar(-1));
+
+    std::vector<cv::Point> indices_queue;
+    indices_queue.reserve(cross_locs_mat.total());
+
+    for (int y = 0; y < cross_locs_mat.rows; ++y)
+    {
+        for (int x = 0; x < cross_locs_mat.cols; ++x)
+        {
+            cv::Point indices(x, y);
+
+            if (cross_locs_mat.at<cv::Point>(indices) != cv::Point(-1, -1))
+            {
+                distances.at<int>(indices) = 0;
+                indices_queue.push_back(indices);
+            }
+        }
+    }
+
+    cv::Rect const indices_roi(cv::Point(0, 0), cross_locs_mat.size());
+
+    for (size_t indices_queue_front = 0; indices_queue_front < indices_queue.size(); ++indices_queue_front)
+    {
+        auto const indices = indices_queue[indices_queue_front];
+        auto const distance = distances.at<int>(indices);
+
+        cv::Point cross_locs_interpolated_sum;
+        int cross_locs_interpolated_n = 0;
+
+        for (auto const& indices_delta : INDICES_DELTAS)
+        {
+            auto const indices_neighbor = indices + indices_delta;
+
+            if (!indices_roi.contains(indices_neighbor))
+            {
+                continue;
+            }
+
+            auto& distance_neighbor = distances.at<int>(indices_neighbor);
+
+            if (distance_neighbor == -1)
+            {
+                distance_neighbor = distance + 1;
+                indices_queue.push_back(indices_neighbor);
+            }
+            else if (distance_neighbor < distance)
+            {
+                auto const direction = indices - indices_neighbor;
+                auto const cross_loc_interpolated =
+                    cross_locs_mat_augmented.at<cv::Point>(indices_neighbor) + cell_side_length * direction;
+
+                cross_locs_interpolated_sum += cross_loc_interpolated;
+                ++cross_locs_interpolated_n;
+            }
+        }
+
+        if (cross_locs_interpolated_n > 0)
+        {
+            cross_locs_mat_augmented.at<cv::Point>(indices) =
+                cross_locs_interpolated_sum / cross_locs_interpolated_n;
+        }
+
+        //draw(image_resized, cross_locs_mat_augmented);
+    }
+
+    return cross_locs_mat_augmented;
+}
+
+
+std::pair<bool, std::map<cv::Point, cv::Point, PointCompare>> CrossLocsDetector::get_cross_locs_main_map_sparse(
+    cv::Mat const& image_thresholded,
+    cv::Point const& cross_loc_init,
+    int const cell_side_length,
+    cv::Mat const& mask_cross,
+    int const mask_cross_perimeter,
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    cv::Size const main_grid_size,
+    Deadline const& deadline)
+{
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_main_map_sparse");
+
+    cv::Size const roi_size(2 * cell_side_length, 2 * cell_side_length);
+
+    auto const get_cross_locs_line_map = [&](
+        cv::Point const& indices_init,
+        cv::Point const& cross_loc_init,
+        bool const is_horizontal)
+    {
+        std::vector<cv::Point> const indices_deltas = is_horizontal ?
+            std::vector<cv::Point>{ INDICES_DELTA_LEFT, INDICES_DELTA_RIGHT } :
+            std::vector<cv::Point>{ INDICES_DELTA_UP, INDICES_DELTA_DOWN };
+
+        std::vector<cv::Point> cross_loc_deltas;
+        for (auto const& indices_delta : indices_deltas)
+        {
+            cross_loc_deltas.push_back(cell_side_length * indices_delta);
+        }
+
+        return get_cross_locs_map(
+            image_thresholded,
+            { indices_init },
+            { cross_loc_init },
+            {},
+            indices_deltas,
+            cross_loc_deltas,
+            roi_size,
+            mask_cross,
+            mask_cross_perimeter,
+            similarity_ratio_min,
+            main_grid_size,
+            options.predict_from_lattice_model,
+            deadline);
+    };
+
+    // The row and the column through the initial cross give the extent of the grid
+    auto const cross_locs_row_map = get_cross_locs_line_map(cv::Point(0, 0), cross_loc_init, true);
+    if (cross_locs_row_map.empty())
+    {
+        return std::make_pair(false, cross_locs_row_map);
+    }
+
+    auto const cross_locs_column_map =
+        get_cross_locs_line_map(cv::Point(0, 0), cross_locs_row_map.at(cv::Point(0, 0)), false);
+    if (cross_locs_column_map.empty())
+    {
+        return std::make_pair(false, cross_locs_row_map);
+    }
+
+    auto const x_min = cross_locs_row_map.begin()->first.x;
+    auto const x_max = cross_locs_row_map.rbegin()->first.x;
+    auto const y_min = cross_locs_column_map.begin()->first.y;
+    auto const y_max = cross_locs_column_map.rbegin()->first.y;
+
+    auto cross_locs_map = cross_locs_row_map;
+    cross_locs_map.insert(cross_locs_column_map.begin(), cross_locs_column_map.end());
+
+    if (x_max - x_min < 2 || y_max - y_min < 2)
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
+
+    // Walk the border of the grid
+
+    std::vector<std::tuple<cv::Point, cv::Point, bool>> const border_lines_init = {
+        std::make_tuple(cv::Point(x_min, 0), cross_locs_row_map.at(cv::Point(x_min, 0)), false),
+        std::make_tuple(cv::Point(x_max, 0), cross_locs_row_map.at(cv::Point(x_max, 0)), false),
+        std::make_tuple(cv::Point(0, y_min), cross_locs_column_map.at(cv::Point(0, y_min)), true),
+        std::make_tuple(cv::Point(0, y_max), cross_locs_column_map.at(cv::Point(0, y_max)), true) };
+
+    for (auto const& border_line_init : border_lines_init)
+    {
+        auto const cross_locs_border_map = get_cross_locs_line_map(
+            std::get<0>(border_line_init),
+            std::get<1>(border_line_init),
+            std::get<2>(border_line_init));
+
+        cross_locs_map.insert(cross_locs_border_map.begin(), cross_locs_border_map.end());
+    }
+
+    auto const error_max = std::max(1.0, options.verification_error_ratio_max * cell_side_length);
+
+    auto const find_homography = [&error_max](std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map)
+    {
+        std::vector<cv::Point2f> indices_points;
+        std::vector<cv::Point2f> cross_loc_points;
+        for (auto const& indices_cross_loc : cross_locs_map)
+        {
+            indices_points.push_back(indices_cross_loc.first);
+            cross_loc_points.push_back(indices_cross_loc.second);
+        }
+
+        return cv::findHomography(indices_points, cross_loc_points, cv::RANSAC, error_max);
+    };
+
+    auto const predict = [](cv::Mat const& homography, std::vector<cv::Point2f> const& indices_points)
+    {
+        std::vector<cv::Point2f> cross_loc_points;
+        cv::perspectiveTransform(indices_points, cross_loc_points, homography);
+
+        return cross_loc_points;
+    };
+
+    if (deadline.is_expired())
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
+
+    auto homography = find_homography(cross_locs_map);
+    if (homography.empty())
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
+
+    // Check the homography on a sample of the interior crosses spread evenly over the grid
+    std::vector<cv::Point2f> indices_sample;
+    {
+        auto const sample_side = static_cast<int>(std::ceil(std::sqrt(std::max(options.verification_sample_size, 1))));
+        auto const interior_width = x_max - x_min - 1;
+        auto const interior_height = y_max - y_min - 1;
+
+        std::set<cv::Point, PointCompare> indices_sample_set;
+        for (int i = 0; i < sample_side; ++i)
+        {
+            for (int j = 0; j < sample_side; ++j)
+            {
+                cv::Point const indices(
+                    x_min + 1 + (2 * j + 1) * interior_width / (2 * sample_side),
+                    y_min + 1 + (2 * i + 1) * interior_height / (2 * sample_side));
+
+                if (cross_locs_map.find(indices) == cross_locs_map.end())
+                {
+                    indices_sample_set.insert(indices);
+                }
+            }
+        }
+
+        indices_sample.assign(indices_sample_set.begin(), indices_sample_set.end());
+    }
+
+    // Nothing to verify the homography on, e.g. the interior is too small, so the full search decides
+    if (indices_sample.empty())
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
+
+    auto const cross_locs_sample_predicted = predict(homography, indices_sample);
+    auto const search_radius = static_cast<int>(std::ceil(error_max));
+    cv::Size const roi_sample_size(mask_cross.cols + 2 * search_radius, mask_cross.rows + 2 * search_radius);
+
+    int failures_n = 0;
+    for (int i = 0; i < indices_sample.size(); ++i)
+    {
+        cv::Point const cross_loc_predicted(cross_locs_sample_predicted[i]);
+
         bool cross_loc_found;
         cv::Point cross_loc;
         std::tie(cross_loc_found, cross_loc) = find_kernel_loc(
             image_thresholded,
-            get_roi(cross_loc_init, roi_size),
+            get_roi(cross_loc_predicted, roi_sample_size),
             mask_cross,
             mask_cross_perimeter,
             similarity_ratio_min);
 
-        if (cross_loc_found)
+        if (cross_loc_found && cv::norm(cross_loc - cross_loc_predicted) <= error_max)
+        {
+            cross_locs_map[cv::Point(indices_sample[i])] = cross_loc;
+        }
+        else
         {
-            //// Draw
-            //{
-            //    cv::circle(image_thresholded_copy, cross_loc, 5, 255, -1);
-            //    cv::circle(image_thresholded_copy, cross_loc, 3, 0, -1);
+            ++failures_n;
+        }
+    }
 
-            //    cv::imshow("image_thresholded_copy", image_thresholded_copy);
-            //    cv::waitKey(1);
-            //}
+    auto const failures_n_max =
+        static_cast<int>(options.verification_failure_ratio_max * indices_sample.size());
+    if (failures_n > failures_n_max)
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
 
-            cross_locs_map[indices] = cross_loc;
+    // Refit with the sample and fill the crosses which were not template matched
+    homography = find_homography(cross_locs_map);
+    if (homography.empty())
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
 
-            for (int i = 0; i < indices_deltas.size(); ++i)
+    std::vector<cv::Point2f> indices_missing;
+    for (auto y = y_min; y <= y_max; ++y)
+    {
+        for (auto x = x_min; x <= x_max; ++x)
+        {
+            if (cross_locs_map.find(cv::Point(x, y)) == cross_locs_map.end())
             {
-                auto const indices_neighbor = indices + indices_deltas[i];
-                bool const was_in_indices_queue =
-                    was_in_indices_queue_set.find(indices_neighbor) != was_in_indices_queue_set.end();
-
-                if (!was_in_indices_queue)
-                {
-                    indices_queue.push(indices_neighbor);
-                    was_in_indices_queue_set.insert(indices_neighbor);
-
-                    auto const cross_loc_neighbor_init = cross_loc + cross_loc_deltas[i];
-                    cross_locs_init_map[indices_neighbor] = cross_loc_neighbor_init;
-                }
+                indices_missing.push_back(cv::Point2f(x, y));
             }
         }
     }
 
-    return cross_locs_map;
+    auto const cross_locs_missing_predicted = predict(homography, indices_missing);
+    for (int i = 0; i < indices_missing.size(); ++i)
+    {
+        cross_locs_map[cv::Point(indices_missing[i])] = cv::Point(cross_locs_missing_predicted[i]);
+    }
+
+    return std::make_pair(true, cross_locs_map);
 }
 
 
-cv::Rect CrossLocsDetector::get_bounding_rectangle(
-    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map)
+std::pair<bool, std::map<cv::Point, cv::Point, PointCompare>> CrossLocsDetector::get_cross_locs_main_map_stride(
+    cv::Mat const& image_thresholded,
+    cv::Point const& cross_loc_init,
+    int const cell_side_length,
+    cv::Mat const& mask_cross,
+    int const mask_cross_perimeter,
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    cv::Size const main_grid_size,
+    Deadline const& deadline)
 {
-    auto const x_min_max_it = std::minmax_element(
-        cross_locs_map.cbegin(),
-        cross_locs_map.cend(),
-        [](std::pair<cv::Point, cv::Point> const& p_1, std::pair<cv::Point, cv::Point> const& p_2)
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_main_map_stride");
+
+    std::map<cv::Point, cv::Point, PointCompare> cross_locs_map;
+
+    // Measure the width of the 5 vertical and the 5 horizontal lines around the initial cross
+    // between the crosses, where the lines of the other direction do not add to it
+    cv::Rect const image_thresholded_roi(cv::Point(0, 0), image_thresholded.size());
+
+    auto const get_line_width = [&](int const phase, bool const is_vertical)
+    {
+        auto line_width = std::numeric_limits<double>::max();
+
+        for (auto const offset : { cell_side_length / 4, -3 * cell_side_length / 4 })
         {
-            auto const& x_1 = p_1.first.x;
-            auto const& x_2 = p_2.first.x;
+            auto const strip_roi = is_vertical ?
+                cv::Rect(
+                    cross_loc_init.x + phase * cell_side_length - cell_side_length / 4,
+                    cross_loc_init.y + offset,
+                    cell_side_length / 2,
+                    cell_side_length / 2) :
+                cv::Rect(
+                    cross_loc_init.x + offset,
+                    cross_loc_init.y + phase * cell_side_length - cell_side_length / 4,
+                    cell_side_length / 2,
+                    cell_side_length / 2);
+
+            if (strip_roi.empty() || !is_inside(image_thresholded_roi, strip_roi))
+            {
+                return -1.0;
+            }
 
-            return x_1 < x_2;
-        });
+            // A filled cell widens the line, so take the narrower of the two
+            auto const ink = cv::sum(image_thresholded(strip_roi))[0];
+            line_width = std::min(line_width, ink / (cell_side_length / 2));
+        }
 
-    auto const y_min_max_it = std::minmax_element(
-        cross_locs_map.cbegin(),
-        cross_locs_map.cend(),
-        [](std::pair<cv::Point, cv::Point> const& p_1, std::pair<cv::Point, cv::Point> const& p_2)
+        return line_width;
+    };
+
+    // The phase of the thick line among the 5 around the initial cross, from -2 to 2
+    auto const get_thick_line = [&](bool const is_vertical)
+    {
+        std::vector<double> line_widths;
+        for (auto phase = -THICK_LINES_STRIDE / 2; phase <= THICK_LINES_STRIDE / 2; ++phase)
         {
-            auto const& y_1 = p_1.first.y;
-            auto const& y_2 = p_2.first.y;
+            line_widths.push_back(get_line_width(phase, is_vertical));
+        }
 
-            return y_1 < y_2;
-        });
+        auto const line_widths_max_it = std::max_element(line_widths.begin(), line_widths.end());
+        auto const phase = static_cast<int>(std::distance(line_widths.begin(), line_widths_max_it)) - THICK_LINES_STRIDE / 2;
+        auto const line_width_max = *line_widths_max_it;
 
-    cv::Rect const bounding_rectangle(
-        cv::Point(x_min_max_it.first->first.x, y_min_max_it.first->first.y),
-        cv::Point(x_min_max_it.second->first.x, y_min_max_it.second->first.y));
+        auto line_widths_sorted = line_widths;
+        std::sort(line_widths_sorted.begin(), line_widths_sorted.end());
+        auto const line_width_median = line_widths_sorted[line_widths_sorted.size() / 2];
 
-    return bounding_rectangle;
-}
+        bool const is_thick =
+            line_widths_sorted.front() >= 0.0 &&
+            line_width_max > 0.0 &&
+            line_width_max >= THICK_LINE_WIDTH_RATIO_MIN * line_width_median;
 
+        return std::make_tuple(is_thick, phase, line_width_max);
+    };
 
-cv::Mat CrossLocsDetector::convert_to_mat(
-    std::map<cv::Point, cv::Point, PointCompare> const& cross_locs_map)
-{
-    if (cross_locs_map.empty())
+    bool thick_line_vertical_found;
+    int phase_x;
+    double line_width_x;
+    std::tie(thick_line_vertical_found, phase_x, line_width_x) = get_thick_line(true);
+
+    bool thick_line_horizontal_found;
+    int phase_y;
+    double line_width_y;
+    std::tie(thick_line_horizontal_found, phase_y, line_width_y) = get_thick_line(false);
+
+    if (!thick_line_vertical_found || !thick_line_horizontal_found)
     {
-        return cv::Mat();
+        return std::make_pair(false, cross_locs_map);
     }
 
-    auto const bounding_rectangle = get_bounding_rectangle(cross_locs_map);
-    auto const cross_loc_mat_size = bounding_rectangle.size() + cv::Size(1, 1);
+    // Find the lattice of the thick lines
+    cv::Mat mask_cross_thick;
+    int mask_cross_thick_perimeter;
+    std::tie(mask_cross_thick, mask_cross_thick_perimeter) = get_mask_cross_thick(
+        cell_side_length,
+        static_cast<int>(std::min(line_width_x, line_width_y)));
 
-    cv::Mat cross_locs_mat(cross_loc_mat_size, CV_32SC2, cv::Scalar(-1, -1));
+    auto const stride_length = THICK_LINES_STRIDE * cell_side_length;
 
-    for (auto x_map = bounding_rectangle.tl().x, x_mat = 0; x_map <= bounding_rectangle.br().x; ++x_map, ++x_mat)
+    std::vector<cv::Point> cross_loc_thick_deltas;
+    for (auto const& indices_delta : INDICES_DELTAS)
     {
-        for (auto y_map = bounding_rectangle.tl().y, y_mat = 0; y_map <= bounding_rectangle.br().y; ++y_map, ++y_mat)
-        {
-            cv::Point indices_map(x_map, y_map);
-            cv::Point indices_mat(x_mat, y_mat);
+        cross_loc_thick_deltas.push_back(stride_length * indices_delta);
+    }
 
-            auto const indices_cross_loc_it = cross_locs_map.find(indices_map);
-            if (indices_cross_loc_it != cross_locs_map.end())
-            {
-                cross_locs_mat.at<cv::Point>(indices_mat) = indices_cross_loc_it->second;
-            }
-        }
+    // The thick lines are THICK_LINES_STRIDE cells apart, the last one is the border of the grid
+    auto const get_thick_span_max = [](int const grid_size)
+    {
+        return grid_size > 0 ? (grid_size + THICK_LINES_STRIDE - 1) / THICK_LINES_STRIDE : 0;
+    };
+
+    auto const cross_locs_thick_map = get_cross_locs_map(
+        image_thresholded,
+        { cv::Point(0, 0) },
+        { cross_loc_init + cell_side_length * cv::Point(phase_x, phase_y) },
+        {},
+        INDICES_DELTAS,
+        cross_loc_thick_deltas,
+        cv::Size(3 * cell_side_length, 3 * cell_side_length),
+        mask_cross_thick,
+        mask_cross_thick_perimeter,
+        options.stride_similarity_ratio_min,
+        cv::Size(get_thick_span_max(main_grid_size.width), get_thick_span_max(main_grid_size.height)),
+        options.predict_from_lattice_model,
+        deadline);
+
+    if (cross_locs_thick_map.empty())
+    {
+        return std::make_pair(false, cross_locs_map);
     }
 
-    return cross_locs_mat;
-}
+    // At least one thick cell is needed to interpolate
+    auto const indices_thick_rect = get_bounding_rectangle(cross_locs_thick_map);
+    if (indices_thick_rect.width < 1 || indices_thick_rect.height < 1)
+    {
+        return std::make_pair(false, cross_locs_map);
+    }
 
+    for (auto const& indices_cross_loc_thick : cross_locs_thick_map)
+    {
+        cross_locs_map[THICK_LINES_STRIDE * indices_cross_loc_thick.first] = indices_cross_loc_thick.second;
+    }
 
-cv::Mat CrossLocsDetector::augment(
-    cv::Mat image_resized,
-    cv::Mat const& cross_locs_mat,
-    int const cell_side_length)
-{
-    std::set<cv::Point, PointCompare> indices_empty_set;
+    // Interpolate the crosses on the thick lines between the found thick crosses,
+    // then inside the thick cells with all 4 corners found
+    std::map<cv::Point, cv::Point2f, PointCompare> cross_locs_interpolated_map;
 
-    for (int y = 0; y < cross_locs_mat.rows; ++y)
+    for (auto const& indices_cross_loc_thick : cross_locs_thick_map)
     {
-        for (int x = 0; x < cross_locs_mat.cols; ++x)
+        auto const& indices_thick = indices_cross_loc_thick.first;
+        cv::Point2f const cross_loc_00(indices_cross_loc_thick.second);
+
+        auto const cross_loc_10_it = cross_locs_thick_map.find(indices_thick + INDICES_DELTA_RIGHT);
+        auto const cross_loc_01_it = cross_locs_thick_map.find(indices_thick + INDICES_DELTA_DOWN);
+        auto const cross_loc_11_it = cross_locs_thick_map.find(indices_thick + INDICES_DELTA_RIGHT + INDICES_DELTA_DOWN);
+
+        bool const has_10 = cross_loc_10_it != cross_locs_thick_map.end();
+        bool const has_01 = cross_loc_01_it != cross_locs_thick_map.end();
+        bool const has_11 = cross_loc_11_it != cross_locs_thick_map.end();
+
+        for (auto i = 1; i < THICK_LINES_STRIDE; ++i)
         {
-            cv::Point indices(x, y);
+            auto const t = static_cast<float>(i) / THICK_LINES_STRIDE;
 
-            if (cross_locs_mat.at<cv::Point>(indices) == cv::Point(-1, -1))
+            if (has_10)
             {
-                indices_empty_set.insert(indices);
+                cross_locs_interpolated_map[THICK_LINES_STRIDE * indices_thick + cv::Point(i, 0)] =
+                    (1.0f - t) * cross_loc_00 + t * cv::Point2f(cross_loc_10_it->second);
             }
-        }
-    }
 
-    cv::Rect const indices_roi(cv::Point(0, 0), cross_locs_mat.size());
-    cv::Mat cross_locs_mat_augmented = cross_locs_mat.clone();
+            if (has_01)
+            {
+                cross_locs_interpolated_map[THICK_LINES_STRIDE * indices_thick + cv::Point(0, i)] =
+                    (1.0f - t) * cross_loc_00 + t * cv::Point2f(cross_loc_01_it->second);
+            }
+        }
 
-    while (!indices_empty_set.empty())
-    {
-        std::map<cv::Point, cv::Point, PointCompare> indices_cross_locs_interpolated_map;
-        for (auto const& indices : indices_empty_set)
+        if (has_10 && has_01 && has_11)
         {
-            std::vector<cv::Point> cross_locs_interpolated;
-
-            for (auto const& indices_delta : INDICES_DELTAS)
+            for (auto i = 1; i < THICK_LINES_STRIDE; ++i)
             {
-                auto const indices_neighbor_1 = indices + indices_delta;
-                auto const indices_neighbor_2 = indices_neighbor_1 + indices_delta;
-
-                std::vector<cv::Point> const indices_neighbors = {
-                    indices_neighbor_1,
-                    /*indices_neighbor_2*/ };
-
-                auto const indices_neighbors_are_in_range = std::all_of(
-                    indices_neighbors.begin(),
-                    indices_neighbors.end(),
-                    [&indices_roi](cv::Point const& indices)
-                    {
-                        return indices_roi.contains(indices);
-                    });
-
-                if (indices_neighbors_are_in_range)
+                for (auto j = 1; j < THICK_LINES_STRIDE; ++j)
                 {
-                    auto const indices_neighbors_have_value = std::all_of(
-                        indices_neighbors.begin(),
-                        indices_neighbors.end(),
-                        [&cross_locs_mat_augmented](cv::Point const& indices)
-                        {
-                            return cross_locs_mat_augmented.at<cv::Point>(indices) != cv::Point(-1, -1);
-                        });
-
-                    if (indices_neighbors_have_value)
-                    {
-                        std::vector<cv::Point> neighbors;
-                        std::transform(
-                            indices_neighbors.begin(),
-                            indices_neighbors.end(),
-                            std::back_inserter(neighbors),
-                            [&cross_locs_mat_augmented](cv::Point const& indices)
-                            {
-                                return cross_locs_mat_augmented.at<cv::Point>(indices);
-                            });
-
-                        auto const direction = indices - indices_neighbors[0];
-                        //auto const cross_loc_interpolated = neighbors[0] + (neighbors[0] - neighbors[1]);
-                        auto const cross_loc_interpolated = neighbors[0] + cell_side_length * direction;
-
-                        cross_locs_interpolated.push_back(cross_loc_interpolated);
-                    }
+                    auto const u = static_cast<float>(j) / THICK_LINES_STRIDE;
+                    auto const v = static_cast<float>(i) / THICK_LINES_STRIDE;
+
+                    cross_locs_interpolated_map[THICK_LINES_STRIDE * indices_thick + cv::Point(j, i)] =
+                        (1.0f - u) * (1.0f - v) * cross_loc_00 +
+                        u * (1.0f - v) * cv::Point2f(cross_loc_10_it->second) +
+                        (1.0f - u) * v * cv::Point2f(cross_loc_01_it->second) +
+                        u * v * cv::Point2f(cross_loc_11_it->second);
                 }
             }
+        }
+    }
 
-            if (!cross_locs_interpolated.empty())
-            {
-                auto const cross_locs_interpolated_sum = std::accumulate(
-                    cross_locs_interpolated.begin(),
-                    cross_locs_interpolated.end(),
-                    cv::Point());
-                auto const cross_locs_interpolated_n = static_cast<int>(cross_locs_interpolated.size());
-                auto const cross_loc_interpolated =
-                    cross_locs_interpolated_sum / cross_locs_interpolated_n;
+    // Refine the interpolated crosses, the thick lattice bounds the error to a fraction of the cell
+    auto const search_radius = std::max(2, cell_side_length / 8);
+    cv::Size const roi_refine_size(mask_cross.cols + 2 * search_radius, mask_cross.rows + 2 * search_radius);
 
-                indices_cross_locs_interpolated_map[indices] = cross_loc_interpolated;
-            }
+    // The crosses kept at their interpolated location are not verified, a failed search does not return them
+    std::vector<cv::Point> indices_unverified;
+    auto const get_cross_locs_verified_map = [&cross_locs_map, &indices_unverified]()
+    {
+        auto cross_locs_verified_map = cross_locs_map;
+        for (auto const& indices : indices_unverified)
+        {
+            cross_locs_verified_map.erase(indices);
         }
 
-        for (auto const& indices_cross_loc_interpolated : indices_cross_locs_interpolated_map)
+        return cross_locs_verified_map;
+    };
+
+    for (auto const& indices_cross_loc_interpolated : cross_locs_interpolated_map)
+    {
+        if (deadline.is_expired())
         {
-            cv::Point indices;
-            cv::Point cross_loc_interpolated;
-            std::tie(indices, cross_loc_interpolated) = indices_cross_loc_interpolated;
+            return std::make_pair(false, get_cross_locs_verified_map());
+        }
 
-            cross_locs_mat_augmented.at<cv::Point>(indices) = cross_loc_interpolated;
+        cv::Point const cross_loc_interpolated(indices_cross_loc_interpolated.second);
 
-            indices_empty_set.erase(indices);
+        bool cross_loc_found;
+        cv::Point cross_loc;
+        std::tie(cross_loc_found, cross_loc) = find_kernel_loc(
+            image_thresholded,
+            get_roi(cross_loc_interpolated, roi_refine_size),
+            mask_cross,
+            mask_cross_perimeter,
+            similarity_ratio_min);
+
+        if (!cross_loc_found)
+        {
+            cross_loc = cross_loc_interpolated;
+            indices_unverified.push_back(indices_cross_loc_interpolated.first);
         }
 
-        //draw(image_resized, cross_locs_mat_augmented);
+        cross_locs_map[indices_cross_loc_interpolated.first] = cross_loc;
     }
 
-    return cross_locs_mat_augmented;
+    auto const failures_n_max =
+        static_cast<int>(options.verification_failure_ratio_max * cross_locs_interpolated_map.size());
+    if (static_cast<int>(indices_unverified.size()) > failures_n_max)
+    {
+        return std::make_pair(false, get_cross_locs_verified_map());
+    }
+
+    // Find the crosses outside of the thick lattice, the grid may not end on a multiple of 5 cells
+    std::vector<cv::Point> cross_loc_deltas;
+    for (auto const& indices_delta : INDICES_DELTAS)
+    {
+        cross_loc_deltas.push_back(cell_side_length * indices_delta);
+    }
+
+    cross_locs_map = get_cross_locs_map(
+        image_thresholded,
+        {},
+        {},
+        cross_locs_map,
+        INDICES_DELTAS,
+        cross_loc_deltas,
+        cv::Size(2 * cell_side_length, 2 * cell_side_length),
+        mask_cross,
+        mask_cross_perimeter,
+        similarity_ratio_min,
+        main_grid_size,
+        options.predict_from_lattice_model,
+        deadline);
+
+    // Another thick line would be found beyond THICK_LINES_STRIDE - 1 cells
+    auto const indices_rect = get_bounding_rectangle(cross_locs_map);
+    cv::Rect const indices_thick_main_rect(
+        THICK_LINES_STRIDE * indices_thick_rect.tl(),
+        indices_thick_rect.size() * THICK_LINES_STRIDE);
+
+    auto const margin_max = THICK_LINES_STRIDE - 1;
+    bool const is_consistent =
+        indices_thick_main_rect.x - indices_rect.x <= margin_max &&
+        indices_thick_main_rect.y - indices_rect.y <= margin_max &&
+        indices_rect.br().x - indices_thick_main_rect.br().x <= margin_max &&
+        indices_rect.br().y - indices_thick_main_rect.br().y <= margin_max;
+
+    return std::make_pair(is_consistent, is_consistent ? cross_locs_map : get_cross_locs_verified_map());
 }
 
 
-cv::Mat CrossLocsDetector::get_cross_locs_main_mat(
+std::tuple<cv::Mat, int, int> CrossLocsDetector::get_cross_locs_main_mat(
     cv::Mat const& image_thresholded,
     cv::Point const& cross_loc_init,
     int const cell_side_length,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    cv::Size const main_grid_size,
+    Deadline const& deadline)
 {
-    auto const mask_length = static_cast<int>(cell_side_length * 1.5f);
-    auto const mask_length_odd = mask_length / 2 * 2 + 1;
-
-    auto const line_width = static_cast<int>(cell_side_length / 4);
-    auto const line_width_half = line_width / 2;
-
-    std::cout << "line_width: " << line_width << std::endl;
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_main_mat");
 
     cv::Mat mask_cross;
     int mask_cross_perimeter;
-    std::tie(mask_cross, mask_cross_perimeter) =
-        get_mask_cross(mask_length_odd, line_width_half);
+    std::tie(mask_cross, mask_cross_perimeter) = get_mask_cross_main(cell_side_length);
 
     //std::cout << mask_cross << std::endl;
     //std::cout << mask_cross_perimeter << std::endl;
@@ -438,16 +1567,63 @@ cv::Mat CrossLocsDetector::get_cross_locs_main_mat(
         cv::Point(0, cell_side_length),
         cv::Point(-cell_side_length, 0) };
 
-    auto const cross_locs_main_map = get_cross_locs_map(
-        image_thresholded,
-        { cv::Point(0, 0) },
-        { cross_loc_init },
-        INDICES_DELTAS,
-        cross_loc_deltas,
-        cv::Size(2 * cell_side_length, 2 * cell_side_length),
-        mask_cross,
-        mask_cross_perimeter,
-        similarity_ratio_min);
+    bool cross_locs_main_map_found = false;
+    std::map<cv::Point, cv::Point, PointCompare> cross_locs_main_map;
+
+    if (options.main_grid_mode == MainGridMode::SPARSE)
+    {
+        std::tie(cross_locs_main_map_found, cross_locs_main_map) = get_cross_locs_main_map_sparse(
+            image_thresholded,
+            cross_loc_init,
+            cell_side_length,
+            mask_cross,
+            mask_cross_perimeter,
+            similarity_ratio_min,
+            options,
+            main_grid_size,
+            deadline);
+    }
+    else if (options.main_grid_mode == MainGridMode::STRIDE)
+    {
+        std::tie(cross_locs_main_map_found, cross_locs_main_map) = get_cross_locs_main_map_stride(
+            image_thresholded,
+            cross_loc_init,
+            cell_side_length,
+            mask_cross,
+            mask_cross_perimeter,
+            similarity_ratio_min,
+            options,
+            main_grid_size,
+            deadline);
+    }
+
+    // The full search resumes from the crosses the sparse (stride) search verified,
+    // out of time, keep what it found
+    if (!cross_locs_main_map_found && !deadline.is_expired())
+    {
+        std::vector<cv::Point> indices_init;
+        std::vector<cv::Point> cross_locs_init;
+        if (cross_locs_main_map.empty())
+        {
+            indices_init.push_back(cv::Point(0, 0));
+            cross_locs_init.push_back(cross_loc_init);
+        }
+
+        cross_locs_main_map = get_cross_locs_map(
+            image_thresholded,
+            indices_init,
+            cross_locs_init,
+            cross_locs_main_map,
+            INDICES_DELTAS,
+            cross_loc_deltas,
+            cv::Size(2 * cell_side_length, 2 * cell_side_length),
+            mask_cross,
+            mask_cross_perimeter,
+            similarity_ratio_min,
+            main_grid_size,
+            options.predict_from_lattice_model,
+            deadline);
+    }
 
     auto cross_locs_main_mat = convert_to_mat(cross_locs_main_map);
 
@@ -463,34 +1639,50 @@ cv::Mat CrossLocsDetector::get_cross_locs_main_mat(
     {
         if (cross_locs_main_mat.empty())
         {
-            return cv::Mat();
+            return std::make_tuple(cv::Mat(), 0, 0);
         }
 
-        // Add extra lines on perimeter
-        auto const cross_locs_main_resized_mat_size = cross_locs_main_mat.size() + cv::Size(2, 2);
+        auto const holes_n = static_cast<int>(cross_locs_main_mat.total() - cross_locs_main_map.size());
+
+        // Add extra lines on perimeter, unless the grid already has the expected size
+        auto const padding_x =
+            main_grid_size.width > 0 && cross_locs_main_mat.cols >= main_grid_size.width + 1 ? 0 : 1;
+        auto const padding_y =
+            main_grid_size.height > 0 && cross_locs_main_mat.rows >= main_grid_size.height + 1 ? 0 : 1;
+
+        auto const cross_locs_main_resized_mat_size =
+            cross_locs_main_mat.size() + cv::Size(2 * padding_x, 2 * padding_y);
 
         cv::Mat cross_locs_main_resized_mat(
             cross_locs_main_resized_mat_size,
             cross_locs_main_mat.type(),
             cv::Scalar(-1, -1));
 
-        cv::Rect const roi(cv::Point(1, 1), cross_locs_main_mat.size());
+        cv::Rect const roi(cv::Point(padding_x, padding_y), cross_locs_main_mat.size());
         cross_locs_main_mat.copyTo(cross_locs_main_resized_mat(roi));
 
         auto const cross_locs_main_resized_augmented_mat =
             augment(cv::Mat(), cross_locs_main_resized_mat, cell_side_length);
 
-        return cross_locs_main_resized_augmented_mat;
+        return std::make_tuple(
+            cross_locs_main_resized_augmented_mat,
+            static_cast<int>(cross_locs_main_map.size()),
+            holes_n);
     }
 }
 
 
-cv::Mat CrossLocsDetector::get_cross_locs_top_mat(
+std::pair<cv::Mat, int> CrossLocsDetector::get_cross_locs_top_mat(
     cv::Mat const& image_thresholded,
     cv::Mat const& cross_locs_main_mat,
     int const cell_side_length,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    cv::Size const main_grid_size,
+    Deadline const& deadline)
 {
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_top_mat");
+
     std::vector<cv::Point> indices_neighbors_init;
     std::vector<cv::Point> cross_locs_neighbors_init;
 
@@ -522,23 +1714,24 @@ cv::Mat CrossLocsDetector::get_cross_locs_top_mat(
         cv::Point(cell_side_length, 0),
         cv::Point(-cell_side_length, 0) };
 
-    auto const cell_side_length_odd = cell_side_length / 2 * 2 + 1;
-
     cv::Mat mask_cross;
     int mask_cross_perimeter;
-    std::tie(mask_cross, mask_cross_perimeter) =
-        get_mask_cross(cell_side_length_odd);
+    std::tie(mask_cross, mask_cross_perimeter) = get_mask_cross_clues(cell_side_length);
 
     auto const cross_locs_top_map = get_cross_locs_map(
         image_thresholded,
         indices_neighbors_init,
         cross_locs_neighbors_init,
+        {},
         indices_deltas,
         cross_loc_deltas,
         cv::Size(2 * cell_side_length, 2 * cell_side_length),
         mask_cross,
         mask_cross_perimeter,
-        similarity_ratio_min);
+        similarity_ratio_min,
+        cv::Size(main_grid_size.width, 0),
+        options.predict_from_lattice_model,
+        deadline);
 
     auto const cross_locs_top_mat = convert_to_mat(cross_locs_top_map);
 
@@ -554,7 +1747,7 @@ cv::Mat CrossLocsDetector::get_cross_locs_top_mat(
     {
         if (cross_locs_top_mat.empty())
         {
-            return cv::Mat();
+            return std::make_pair(cv::Mat(), 0);
         }
 
         // Add extra line to the top and extra column to the right
@@ -571,17 +1764,24 @@ cv::Mat CrossLocsDetector::get_cross_locs_top_mat(
         auto cross_locs_top_resized_augmented_mat =
             augment(cv::Mat(), cross_locs_top_resized_mat, cell_side_length);
 
-        return cross_locs_top_resized_augmented_mat;
+        return std::make_pair(
+            cross_locs_top_resized_augmented_mat,
+            static_cast<int>(cross_locs_top_map.size()));
     }
 }
 
 
-cv::Mat CrossLocsDetector::get_cross_locs_left_mat(
+std::pair<cv::Mat, int> CrossLocsDetector::get_cross_locs_left_mat(
     cv::Mat const& image_thresholded,
     cv::Mat const& cross_locs_main_mat,
     int const cell_side_length,
-    double const similarity_ratio_min)
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    cv::Size const main_grid_size,
+    Deadline const& deadline)
 {
+    NG_TRACE_SPAN(trace_span, "get_cross_locs_left_mat");
+
     std::vector<cv::Point> indices_neighbors_init;
     std::vector<cv::Point> cross_locs_neighbors_init;
 
@@ -612,23 +1812,24 @@ cv::Mat CrossLocsDetector::get_cross_locs_left_mat(
         cv::Point(0, cell_side_length),
         cv::Point(-cell_side_length, 0) };
 
-    auto const cell_side_length_odd = cell_side_length / 2 * 2 + 1;
-
     cv::Mat mask_cross;
     int mask_cross_perimeter;
-    std::tie(mask_cross, mask_cross_perimeter) =
-        ng::get_mask_cross(cell_side_length_odd);
+    std::tie(mask_cross, mask_cross_perimeter) = get_mask_cross_clues(cell_side_length);
 
     auto const cross_locs_left_map = get_cross_locs_map(
         image_thresholded,
         indices_neighbors_init,
         cross_locs_neighbors_init,
+        {},
         indices_deltas,
         cross_loc_deltas,
         cv::Size(2 * cell_side_length, 2 * cell_side_length),
         mask_cross,
         mask_cross_perimeter,
-        similarity_ratio_min);
+        similarity_ratio_min,
+        cv::Size(0, main_grid_size.height),
+        options.predict_from_lattice_model,
+        deadline);
 
     auto cross_locs_left_mat = convert_to_mat(cross_locs_left_map);
 
@@ -644,7 +1845,7 @@ cv::Mat CrossLocsDetector::get_cross_locs_left_mat(
     {
         if (cross_locs_left_mat.empty())
         {
-            return cv::Mat();
+            return std::make_pair(cv::Mat(), 0);
         }
 
         // Add extra line to the bottom and extra column to the left
@@ -661,8 +1862,142 @@ cv::Mat CrossLocsDetector::get_cross_locs_left_mat(
         auto cross_locs_left_resized_augmented_mat =
             augment(cv::Mat(), cross_locs_left_resized_mat, cell_side_length);
 
-        return cross_locs_left_resized_augmented_mat;
+        return std::make_pair(
+            cross_locs_left_resized_augmented_mat,
+            static_cast<int>(cross_locs_left_map.size()));
+    }
+}
+
+
+std::pair<cv::Mat, bool> CrossLocsDetector::refine(
+    cv::Mat const& image_thresholded,
+    cv::Mat const& cross_locs_mat,
+    int const scale_factor,
+    cv::Mat const& mask_cross,
+    int const mask_cross_perimeter,
+    double const similarity_ratio_min,
+    Deadline const& deadline)
+{
+    NG_TRACE_SPAN(trace_span, "refine");
+
+    cv::Mat cross_locs_refined_mat(cross_locs_mat.size(), cross_locs_mat.type(), cv::Scalar(-1, -1));
+    auto is_refined = true;
+
+    // A coarse pixel covers <scale_factor> fine pixels, so the upscaled location is off by less than that
+    auto const search_radius = scale_factor;
+    cv::Size const roi_size(mask_cross.cols + 2 * search_radius, mask_cross.rows + 2 * search_radius);
+
+    for (int y = 0; y < cross_locs_mat.rows; ++y)
+    {
+        for (int x = 0; x < cross_locs_mat.cols; ++x)
+        {
+            auto const& cross_loc = cross_locs_mat.at<cv::Point>(y, x);
+
+            if (cross_loc == cv::Point(-1, -1))
+            {
+                continue;
+            }
+
+            auto const cross_loc_upscaled = scale_factor * cross_loc + cv::Point(scale_factor / 2, scale_factor / 2);
+
+            bool cross_loc_found = false;
+            cv::Point cross_loc_refined;
+            if (!deadline.is_expired())
+            {
+                std::tie(cross_loc_found, cross_loc_refined) = find_kernel_loc(
+                    image_thresholded,
+                    get_roi(cross_loc_upscaled, roi_size),
+                    mask_cross,
+                    mask_cross_perimeter,
+                    similarity_ratio_min);
+            }
+            else
+            {
+                is_refined = false;
+            }
+
+            // Interpolated crosses may have nothing to match, they keep the upscaled location
+            cross_locs_refined_mat.at<cv::Point>(y, x) = cross_loc_found ? cross_loc_refined : cross_loc_upscaled;
+        }
+    }
+
+    return std::make_pair(cross_locs_refined_mat, is_refined);
+}
+
+
+void CrossLocsDetector::run_stages(std::vector<std::function<void()>> const& stages, DetectionOptions const& options)
+{
+    if (options.scheduler)
+    {
+        auto const allocation_account = get_allocation_account();
+
+        options.scheduler->parallel_for(
+            static_cast<int>(stages.size()),
+            [&stages, allocation_account](int const stage_index)
+            {
+                AllocationAccountBinding allocation_account_binding(allocation_account);
+                stages[stage_index]();
+            });
+    }
+    else
+    {
+        for (auto const& stage : stages)
+        {
+            stage();
+        }
+    }
+}
+
+
+StageProgress CrossLocsDetector::get_stage_progress(int const found_n, bool const is_completed)
+{
+    StageProgress stage_progress;
+    stage_progress.is_completed = is_completed;
+    stage_progress.found_n = found_n;
+
+    return stage_progress;
+}
+
+
+cv::Mat CrossLocsDetector::rescale(cv::Mat const& cross_locs_mat, float const scale, cv::Point2f const& offset)
+{
+    cv::Mat cross_locs_rescaled_mat = cross_locs_mat.clone();
+
+    std::for_each(
+        cross_locs_rescaled_mat.begin<cv::Point>(),
+        cross_locs_rescaled_mat.end<cv::Point>(),
+        [scale, &offset](cv::Point& cross_loc)
+        {
+            if (cross_loc != cv::Point(-1, -1))
+            {
+                cross_loc = cv::Point(cvRound(cross_loc.x / scale + offset.x), cvRound(cross_loc.y / scale + offset.y));
+            }
+        });
+
+    return cross_locs_rescaled_mat;
+}
+
+
+cv::Rect CrossLocsDetector::get_crop_roi(cv::Size const& image_size, DetectionHints const& hints)
+{
+    cv::Rect const image_roi(cv::Point(0, 0), image_size);
+
+    if (hints.quad.empty())
+    {
+        return image_roi;
     }
+
+    auto const quad_roi = cv::boundingRect(hints.quad);
+    auto const margin_x = static_cast<int>(hints.quad_margin_ratio * quad_roi.width);
+    auto const margin_y = static_cast<int>(hints.quad_margin_ratio * quad_roi.height);
+
+    auto const crop_roi = cv::Rect(
+        quad_roi.x - margin_x,
+        quad_roi.y - margin_y,
+        quad_roi.width + 2 * margin_x,
+        quad_roi.height + 2 * margin_y) & image_roi;
+
+    return crop_roi.empty() ? image_roi : crop_roi;
 }
 
 
@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "deadline.hpp"
+
+namespace ng
+{
+
+Deadline::Deadline(CancellationToken const& cancellation_token)
+    : Deadline(std::chrono::steady_clock::time_point::max(), cancellation_token)
+{
+}
+
+
+Deadline::Deadline(
+    std::chrono::steady_clock::time_point const& time_point,
+    CancellationToken const& cancellation_token)
+    : m_time_point(time_point)
+    , m_cancellation_tokens({ cancellation_token })
+{
+}
+
+
+Deadline Deadline::from_budget(
+    std::chrono::steady_clock::duration const& budget,
+    CancellationToken const& cancellation_token)
+{
+    return Deadline(std::chrono::steady_clock::now() + budget, cancellation_token);
+}
+
+
+Deadline Deadline::with_cancellation_token(CancellationToken const& cancellation_token) const
+{
+    auto deadline = *this;
+    deadline.m_cancellation_tokens.push_back(cancellation_token);
+
+    return deadline;
+}
+
+
+bool Deadline::is_expired() const
+{
+    auto const is_cancelled = std::any_of(
+        m_cancellation_tokens.begin(),
+        m_cancellation_tokens.end(),
+        [](CancellationToken const& cancellation_token)
+        {
+            return cancellation_token.is_cancelled();
+        });
+
+    if (is_cancelled)
+    {
+        return true;
+    }
+
+    return m_time_point != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() >= m_time_point;
+}
+
+}
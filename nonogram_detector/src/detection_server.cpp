@@ -0,0 +1,514 @@
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <memory>
+
+#include "deadline.hpp"
+#include "detection_server.hpp"
+#include "image_loader.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace ng
+{
+
+namespace
+{
+
+// Larger frames are treated as a broken stream
+uint32_t const FRAME_SIZE_MAX = 256 * 1024 * 1024;
+
+
+#ifndef _WIN32
+
+bool read_all(int const fd, void* data, size_t const size)
+{
+    auto data_p = static_cast<unsigned char*>(data);
+    size_t size_read = 0;
+
+    while (size_read < size)
+    {
+        auto const result = ::read(fd, data_p + size_read, size - size_read);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (result <= 0)
+        {
+            return false;
+        }
+
+        size_read += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+
+bool write_all(int const fd, void const* data, size_t const size)
+{
+    auto data_p = static_cast<unsigned char const*>(data);
+    size_t size_written = 0;
+
+    while (size_written < size)
+    {
+        auto const result = ::write(fd, data_p + size_written, size - size_written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (result <= 0)
+        {
+            return false;
+        }
+
+        size_written += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+
+// Returns false at the end of the stream or on a broken frame
+bool read_frame(int const fd, std::vector<unsigned char>& payload)
+{
+    unsigned char size_bytes[4];
+    if (!read_all(fd, size_bytes, sizeof(size_bytes)))
+    {
+        return false;
+    }
+
+    auto const size =
+        static_cast<uint32_t>(size_bytes[0]) |
+        static_cast<uint32_t>(size_bytes[1]) << 8 |
+        static_cast<uint32_t>(size_bytes[2]) << 16 |
+        static_cast<uint32_t>(size_bytes[3]) << 24;
+
+    if (size > FRAME_SIZE_MAX)
+    {
+        return false;
+    }
+
+    payload.resize(size);
+
+    return size == 0 || read_all(fd, payload.data(), size);
+}
+
+
+bool write_frame(int const fd, std::vector<unsigned char> const& payload)
+{
+    auto const size = static_cast<uint32_t>(payload.size());
+
+    unsigned char const size_bytes[4] = {
+        static_cast<unsigned char>(size),
+        static_cast<unsigned char>(size >> 8),
+        static_cast<unsigned char>(size >> 16),
+        static_cast<unsigned char>(size >> 24) };
+
+    return write_all(fd, size_bytes, sizeof(size_bytes)) && write_all(fd, payload.data(), payload.size());
+}
+
+
+// The boolean flag shows if <socket_path> fits the address
+std::pair<bool, sockaddr_un> get_socket_address(std::string const& socket_path)
+{
+    sockaddr_un socket_address = {};
+    socket_address.sun_family = AF_UNIX;
+
+    if (socket_path.empty() || socket_path.size() >= sizeof(socket_address.sun_path))
+    {
+        return std::make_pair(false, socket_address);
+    }
+
+    std::memcpy(socket_address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    return std::make_pair(true, socket_address);
+}
+
+#endif
+
+}
+
+
+DetectionServer::DetectionServer(
+    CrossLocsDetector const& cross_locs_detector,
+    ThresholdProfile const& threshold_profile,
+    DetectionServerOptions const& options)
+    : M_THRESHOLD_PROFILE(threshold_profile)
+    , M_OPTIONS(options)
+    , m_async_cross_locs_detector(cross_locs_detector, options.workers_n, options.queue_capacity)
+    , m_listen_fd(-1)
+    , m_is_stopping(false)
+{
+}
+
+
+DetectionServer::~DetectionServer()
+{
+    stop();
+}
+
+
+std::vector<unsigned char> DetectionServer::handle_request(std::vector<unsigned char> const& request)
+{
+    GridRecord grid_record;
+    grid_record.threshold_profile = M_THRESHOLD_PROFILE;
+
+    if (request.empty())
+    {
+        return make_response(DetectionResponseStatus::FAILED, grid_record);
+    }
+
+    auto const request_type = static_cast<DetectionRequestType>(request.front());
+    auto const data = request.data() + 1;
+    auto const size = request.size() - 1;
+
+    // A bad request must not end the connection thread, so whatever the decoding or the detection throws
+    // (the future passes the exceptions of the workers through) fails the request only
+    try
+    {
+        cv::Mat image;
+        float input_scale = 1.0f;
+
+        switch (request_type)
+        {
+        case DetectionRequestType::IMAGE:
+            std::tie(image, input_scale) = decode_image_reduced(data, size, M_OPTIONS.decode_width_height_min);
+            break;
+
+        case DetectionRequestType::PATH:
+            grid_record.source.assign(reinterpret_cast<char const*>(data), size);
+            std::tie(image, input_scale) = load_image_reduced(grid_record.source, M_OPTIONS.decode_width_height_min);
+            break;
+
+        default:
+            return make_response(DetectionResponseStatus::FAILED, grid_record);
+        }
+
+        if (image.empty())
+        {
+            return make_response(DetectionResponseStatus::NOT_DECODED, grid_record);
+        }
+
+        // The grids are returned in the coordinates of the encoded image
+        DetectionHints hints;
+        hints.input_scale = input_scale;
+
+        auto const deadline = M_OPTIONS.detection_budget.count() > 0 ?
+            Deadline::from_budget(M_OPTIONS.detection_budget, m_cancellation_token) :
+            Deadline(m_cancellation_token);
+
+        grid_record.detection_result = m_async_cross_locs_detector.submit(
+            std::make_shared<cv::Mat const>(image),
+            hints,
+            deadline).get();
+    }
+    catch (std::exception const&)
+    {
+        return make_response(DetectionResponseStatus::FAILED, grid_record);
+    }
+
+    return make_response(DetectionResponseStatus::OK, grid_record);
+}
+
+
+std::vector<unsigned char> DetectionServer::make_response(
+    DetectionResponseStatus const status,
+    GridRecord const& grid_record)
+{
+    auto response = encode_grid_record(grid_record);
+    response.insert(response.begin(), static_cast<unsigned char>(status));
+
+    return response;
+}
+
+
+#ifdef _WIN32
+
+bool DetectionServer::serve(std::string const& socket_path)
+{
+    return false;
+}
+
+
+bool DetectionServer::serve_stream(int const input_fd, int const output_fd)
+{
+    return false;
+}
+
+
+void DetectionServer::stop()
+{
+    m_cancellation_token.cancel();
+}
+
+
+void DetectionServer::serve_connection(int const connection_fd)
+{
+}
+
+
+DetectionClient::DetectionClient()
+    : m_fd(-1)
+{
+}
+
+
+DetectionClient::~DetectionClient()
+{
+}
+
+
+bool DetectionClient::connect(std::string const& socket_path)
+{
+    return false;
+}
+
+
+void DetectionClient::close()
+{
+}
+
+
+std::tuple<bool, DetectionResponseStatus, GridRecord> DetectionClient::send_request(
+    std::vector<unsigned char> const& request)
+{
+    return std::make_tuple(false, DetectionResponseStatus::FAILED, GridRecord());
+}
+
+#else
+
+bool DetectionServer::serve(std::string const& socket_path)
+{
+    bool socket_address_valid;
+    sockaddr_un socket_address;
+    std::tie(socket_address_valid, socket_address) = get_socket_address(socket_path);
+
+    if (!socket_address_valid)
+    {
+        return false;
+    }
+
+    auto const listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        return false;
+    }
+
+    ::unlink(socket_path.c_str());
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr const*>(&socket_address), sizeof(socket_address)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0)
+    {
+        ::close(listen_fd);
+
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_is_stopping)
+        {
+            ::close(listen_fd);
+
+            return true;
+        }
+
+        m_listen_fd = listen_fd;
+    }
+
+    while (true)
+    {
+        auto const connection_fd = ::accept(listen_fd, nullptr, nullptr);
+        if (connection_fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            // stop() shuts the listening socket down
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_is_stopping)
+        {
+            ::close(connection_fd);
+
+            break;
+        }
+
+        // The finished threads are not kept, a long running server accepts any number of connections
+        m_connection_fds.insert(connection_fd);
+        std::thread(&DetectionServer::serve_connection, this, connection_fd).detach();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // A connection thread removes its descriptor under the lock as its last access to the server,
+        // after its last handle_request, so the server may be destroyed once the set is empty
+        m_connections_closed.wait(lock, [this]() { return m_connection_fds.empty(); });
+
+        m_listen_fd = -1;
+    }
+
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+
+    return true;
+}
+
+
+bool DetectionServer::serve_stream(int const input_fd, int const output_fd)
+{
+    std::vector<unsigned char> request;
+
+    while (read_frame(input_fd, request))
+    {
+        if (!write_frame(output_fd, handle_request(request)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void DetectionServer::stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_is_stopping = true;
+    m_cancellation_token.cancel();
+
+    // Wakes up accept() and the blocked reads, the descriptors are closed by their owners
+    if (m_listen_fd >= 0)
+    {
+        ::shutdown(m_listen_fd, SHUT_RDWR);
+    }
+
+    for (auto const connection_fd : m_connection_fds)
+    {
+        ::shutdown(connection_fd, SHUT_RDWR);
+    }
+}
+
+
+void DetectionServer::serve_connection(int const connection_fd)
+{
+    serve_stream(connection_fd, connection_fd);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_connection_fds.erase(connection_fd);
+    ::close(connection_fd);
+
+    m_connections_closed.notify_all();
+}
+
+
+DetectionClient::DetectionClient()
+    : m_fd(-1)
+{
+}
+
+
+DetectionClient::~DetectionClient()
+{
+    close();
+}
+
+
+bool DetectionClient::connect(std::string const& socket_path)
+{
+    close();
+
+    bool socket_address_valid;
+    sockaddr_un socket_address;
+    std::tie(socket_address_valid, socket_address) = get_socket_address(socket_path);
+
+    if (!socket_address_valid)
+    {
+        return false;
+    }
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    if (::connect(m_fd, reinterpret_cast<sockaddr const*>(&socket_address), sizeof(socket_address)) != 0)
+    {
+        close();
+
+        return false;
+    }
+
+    return true;
+}
+
+
+void DetectionClient::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+
+std::tuple<bool, DetectionResponseStatus, GridRecord> DetectionClient::send_request(
+    std::vector<unsigned char> const& request)
+{
+    std::vector<unsigned char> response;
+
+    if (m_fd < 0 || !write_frame(m_fd, request) || !read_frame(m_fd, response) || response.empty())
+    {
+        return std::make_tuple(false, DetectionResponseStatus::FAILED, GridRecord());
+    }
+
+    bool grid_record_decoded;
+    GridRecord grid_record;
+    std::tie(grid_record_decoded, grid_record) = decode_grid_record(response.data() + 1, response.size() - 1);
+
+    return std::make_tuple(grid_record_decoded, static_cast<DetectionResponseStatus>(response.front()), grid_record);
+}
+
+#endif
+
+
+std::tuple<bool, DetectionResponseStatus, GridRecord> DetectionClient::detect_path(std::string const& image_path)
+{
+    std::vector<unsigned char> request;
+    request.push_back(static_cast<unsigned char>(DetectionRequestType::PATH));
+    request.insert(request.end(), image_path.begin(), image_path.end());
+
+    return send_request(request);
+}
+
+
+std::tuple<bool, DetectionResponseStatus, GridRecord> DetectionClient::detect_image(
+    unsigned char const* data,
+    size_t const size)
+{
+    std::vector<unsigned char> request;
+    request.push_back(static_cast<unsigned char>(DetectionRequestType::IMAGE));
+    request.insert(request.end(), data, data + size);
+
+    return send_request(request);
+}
+
+}
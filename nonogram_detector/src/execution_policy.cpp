@@ -0,0 +1,43 @@
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "execution_policy.hpp"
+
+namespace ng
+{
+
+ExecutionPolicy get_execution_policy(int const images_n, int const cores_n)
+{
+    auto const cores_n_valid = std::max(cores_n, 1);
+
+    ExecutionPolicy execution_policy;
+    execution_policy.image_workers_n = std::min(std::max(images_n, 1), cores_n_valid);
+    execution_policy.detect_threads_n = cores_n_valid / execution_policy.image_workers_n;
+
+    // The threads of a detection are the scheduler workers (see make_scheduler), an OpenCV pool of the same size
+    // would double them, so the OpenCV calls run on the calling thread
+    execution_policy.opencv_threads_n = 1;
+
+    return execution_policy;
+}
+
+
+void apply_execution_policy(ExecutionPolicy const& execution_policy)
+{
+    // 0 runs the OpenCV functions sequentially
+    cv::setNumThreads(execution_policy.opencv_threads_n > 1 ? execution_policy.opencv_threads_n : 0);
+}
+
+
+std::shared_ptr<WorkStealingScheduler> make_scheduler(ExecutionPolicy const& execution_policy)
+{
+    // The threads calling detect take part in its parallel loops
+    auto const workers_n = execution_policy.image_workers_n * (execution_policy.detect_threads_n - 1);
+
+    return workers_n > 0 ?
+        std::make_shared<WorkStealingScheduler>(workers_n) :
+        std::shared_ptr<WorkStealingScheduler>();
+}
+
+}
@@ -0,0 +1,916 @@
+#include <cstdint>
+#include <cstring>
+
+#include "grid_serialization.hpp"
+
+namespace ng
+{
+
+namespace
+{
+
+char const GRID_RECORD_MAGIC[4] = { 'N', 'G', 'G', 'R' };
+
+// 2 added the holes of every stage and the allocation stats
+uint32_t const GRID_RECORD_VERSION = 2;
+
+size_t const GRID_RECORD_HEADER_SIZE = sizeof(GRID_RECORD_MAGIC) + sizeof(GRID_RECORD_VERSION);
+
+cv::Point const CROSS_LOC_NOT_FOUND(-1, -1);
+
+unsigned char const RECORD_FLAG_FOUND = 1 << 0;
+unsigned char const RECORD_FLAG_PARTIAL = 1 << 1;
+unsigned char const RECORD_FLAG_SEED_COMPLETED = 1 << 2;
+unsigned char const RECORD_FLAG_MAIN_GRID_COMPLETED = 1 << 3;
+unsigned char const RECORD_FLAG_TOP_GRID_COMPLETED = 1 << 4;
+unsigned char const RECORD_FLAG_LEFT_GRID_COMPLETED = 1 << 5;
+
+unsigned char const GRID_FLAG_MISSING = 1 << 0;
+
+// Larger grids are treated as broken records
+uint64_t const GRID_ROWS_COLS_MAX = 1 << 16;
+
+
+// Floats are stored in the byte order of the host, the files are written and read on little endian machines
+template <typename T>
+void put_value(std::vector<unsigned char>& buffer, T const value)
+{
+    auto const value_p = reinterpret_cast<unsigned char const*>(&value);
+    buffer.insert(buffer.end(), value_p, value_p + sizeof(value));
+}
+
+
+void put_varint(std::vector<unsigned char>& buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+
+    buffer.push_back(static_cast<unsigned char>(value));
+}
+
+
+// Small negative values are coded with few bytes as well
+void put_varint_signed(std::vector<unsigned char>& buffer, int64_t const value)
+{
+    put_varint(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+
+void put_string(std::vector<unsigned char>& buffer, std::string const& value)
+{
+    put_varint(buffer, value.size());
+    buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+
+// Reads the values one by one and fails once the data ends
+class ByteReader
+{
+public:
+    ByteReader(unsigned char const* data, size_t const size)
+        : m_data_p(data)
+        , m_data_end(data + size)
+    {
+    }
+
+    size_t get_size_left() const
+    {
+        return static_cast<size_t>(m_data_end - m_data_p);
+    }
+
+    bool read_bytes(void* value_p, size_t const size)
+    {
+        if (get_size_left() < size)
+        {
+            return false;
+        }
+
+        std::memcpy(value_p, m_data_p, size);
+        m_data_p += size;
+
+        return true;
+    }
+
+    template <typename T>
+    bool read_value(T& value)
+    {
+        return read_bytes(&value, sizeof(value));
+    }
+
+    bool read_varint(uint64_t& value)
+    {
+        value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (m_data_p == m_data_end)
+            {
+                return false;
+            }
+
+            auto const byte = *m_data_p++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool read_varint_signed(int64_t& value)
+    {
+        uint64_t value_zigzag;
+        if (!read_varint(value_zigzag))
+        {
+            return false;
+        }
+
+        value = static_cast<int64_t>(value_zigzag >> 1) ^ -static_cast<int64_t>(value_zigzag & 1);
+
+        return true;
+    }
+
+    bool read_string(std::string& value)
+    {
+        uint64_t size;
+        if (!read_varint(size) || get_size_left() < size)
+        {
+            return false;
+        }
+
+        value.assign(reinterpret_cast<char const*>(m_data_p), static_cast<size_t>(size));
+        m_data_p += size;
+
+        return true;
+    }
+
+private:
+    unsigned char const* m_data_p;
+    unsigned char const* m_data_end;
+};
+
+
+// Model is (x0, x per col, x per row, y0, y per col, y per row), all zeros if there are no crosses
+std::vector<float> get_lattice_model(cv::Mat const& cross_locs_mat)
+{
+    std::vector<float> model(6, 0.0f);
+
+    std::vector<cv::Point> indices;
+    std::vector<cv::Point> cross_locs;
+    for (int row = 0; row < cross_locs_mat.rows; ++row)
+    {
+        for (int col = 0; col < cross_locs_mat.cols; ++col)
+        {
+            auto const& cross_loc = cross_locs_mat.at<cv::Point>(row, col);
+            if (cross_loc != CROSS_LOC_NOT_FOUND)
+            {
+                indices.emplace_back(col, row);
+                cross_locs.push_back(cross_loc);
+            }
+        }
+    }
+
+    if (indices.empty())
+    {
+        return model;
+    }
+
+    cv::Mat a(static_cast<int>(indices.size()), 3, CV_64F);
+    cv::Mat b(static_cast<int>(indices.size()), 2, CV_64F);
+    for (int i = 0; i < a.rows; ++i)
+    {
+        a.at<double>(i, 0) = 1.0;
+        a.at<double>(i, 1) = indices[i].x;
+        a.at<double>(i, 2) = indices[i].y;
+
+        b.at<double>(i, 0) = cross_locs[i].x;
+        b.at<double>(i, 1) = cross_locs[i].y;
+    }
+
+    // SVD gives the least squares solution for a single row (column) of crosses as well
+    cv::Mat coefficients;
+    cv::solve(a, b, coefficients, cv::DECOMP_SVD);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        model[i] = static_cast<float>(coefficients.at<double>(i, 0));
+        model[3 + i] = static_cast<float>(coefficients.at<double>(i, 1));
+    }
+
+    return model;
+}
+
+
+// The encoder and the decoder predict from the same float model
+cv::Point predict_cross_loc(std::vector<float> const& model, int const row, int const col)
+{
+    return cv::Point(
+        cvRound(static_cast<double>(model[0]) + static_cast<double>(model[1]) * col + static_cast<double>(model[2]) * row),
+        cvRound(static_cast<double>(model[3]) + static_cast<double>(model[4]) * col + static_cast<double>(model[5]) * row));
+}
+
+
+// Parallelogram prediction of the residual at <index> from the found neighbors
+cv::Point predict_residual(
+    std::vector<cv::Point> const& residuals,
+    std::vector<bool> const& found,
+    int const cols,
+    int const row,
+    int const col)
+{
+    auto const index = row * cols + col;
+
+    auto const left_found = col > 0 && found[index - 1];
+    auto const up_found = row > 0 && found[index - cols];
+    auto const up_left_found = col > 0 && row > 0 && found[index - cols - 1];
+
+    if (left_found && up_found && up_left_found)
+    {
+        return residuals[index - 1] + residuals[index - cols] - residuals[index - cols - 1];
+    }
+
+    if (left_found)
+    {
+        return residuals[index - 1];
+    }
+
+    if (up_found)
+    {
+        return residuals[index - cols];
+    }
+
+    return cv::Point();
+}
+
+
+void put_grid(std::vector<unsigned char>& buffer, cv::Mat const& cross_locs_mat)
+{
+    auto const rows = cross_locs_mat.rows;
+    auto const cols = cross_locs_mat.cols;
+
+    put_varint(buffer, static_cast<uint64_t>(rows));
+    put_varint(buffer, static_cast<uint64_t>(cols));
+
+    if (rows == 0 || cols == 0)
+    {
+        return;
+    }
+
+    std::vector<bool> found(rows * cols);
+    std::vector<unsigned char> found_bitmap((rows * cols + 7) / 8, 0);
+    auto missing_n = 0;
+    for (int index = 0; index < rows * cols; ++index)
+    {
+        found[index] = cross_locs_mat.at<cv::Point>(index / cols, index % cols) != CROSS_LOC_NOT_FOUND;
+
+        if (found[index])
+        {
+            found_bitmap[index / 8] |= static_cast<unsigned char>(1 << (index % 8));
+        }
+        else
+        {
+            ++missing_n;
+        }
+    }
+
+    // The bitmap is skipped for the complete grids
+    buffer.push_back(missing_n > 0 ? GRID_FLAG_MISSING : 0);
+    if (missing_n > 0)
+    {
+        buffer.insert(buffer.end(), found_bitmap.begin(), found_bitmap.end());
+    }
+
+    auto const model = get_lattice_model(cross_locs_mat);
+    for (auto const coefficient : model)
+    {
+        put_value(buffer, coefficient);
+    }
+
+    std::vector<cv::Point> residuals(rows * cols);
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int col = 0; col < cols; ++col)
+        {
+            auto const index = row * cols + col;
+            if (!found[index])
+            {
+                continue;
+            }
+
+            residuals[index] = cross_locs_mat.at<cv::Point>(row, col) - predict_cross_loc(model, row, col);
+
+            auto const residual_delta = residuals[index] - predict_residual(residuals, found, cols, row, col);
+            put_varint_signed(buffer, residual_delta.x);
+            put_varint_signed(buffer, residual_delta.y);
+        }
+    }
+}
+
+
+bool read_grid(ByteReader& byte_reader, cv::Mat& cross_locs_mat)
+{
+    uint64_t rows;
+    uint64_t cols;
+    if (!byte_reader.read_varint(rows) || !byte_reader.read_varint(cols) ||
+        rows > GRID_ROWS_COLS_MAX || cols > GRID_ROWS_COLS_MAX)
+    {
+        return false;
+    }
+
+    if (rows == 0 || cols == 0)
+    {
+        cross_locs_mat = cv::Mat();
+
+        return true;
+    }
+
+    // Every cross takes at least a bit
+    if (rows * cols > 8 * byte_reader.get_size_left())
+    {
+        return false;
+    }
+
+    auto const rows_n = static_cast<int>(rows);
+    auto const cols_n = static_cast<int>(cols);
+
+    unsigned char grid_flags;
+    if (!byte_reader.read_value(grid_flags))
+    {
+        return false;
+    }
+
+    std::vector<bool> found(rows_n * cols_n, true);
+    if (grid_flags & GRID_FLAG_MISSING)
+    {
+        std::vector<unsigned char> found_bitmap((rows_n * cols_n + 7) / 8);
+        if (!byte_reader.read_bytes(found_bitmap.data(), found_bitmap.size()))
+        {
+            return false;
+        }
+
+        for (int index = 0; index < rows_n * cols_n; ++index)
+        {
+            found[index] = (found_bitmap[index / 8] >> (index % 8)) & 1;
+        }
+    }
+
+    std::vector<float> model(6);
+    for (auto& coefficient : model)
+    {
+        if (!byte_reader.read_value(coefficient))
+        {
+            return false;
+        }
+    }
+
+    cross_locs_mat = cv::Mat(rows_n, cols_n, CV_32SC2, cv::Scalar(-1, -1));
+
+    std::vector<cv::Point> residuals(rows_n * cols_n);
+    for (int row = 0; row < rows_n; ++row)
+    {
+        for (int col = 0; col < cols_n; ++col)
+        {
+            auto const index = row * cols_n + col;
+            if (!found[index])
+            {
+                continue;
+            }
+
+            int64_t residual_delta_x;
+            int64_t residual_delta_y;
+            if (!byte_reader.read_varint_signed(residual_delta_x) || !byte_reader.read_varint_signed(residual_delta_y))
+            {
+                return false;
+            }
+
+            residuals[index] =
+                predict_residual(residuals, found, cols_n, row, col) +
+                cv::Point(static_cast<int>(residual_delta_x), static_cast<int>(residual_delta_y));
+
+            cross_locs_mat.at<cv::Point>(row, col) = predict_cross_loc(model, row, col) + residuals[index];
+        }
+    }
+
+    return true;
+}
+
+
+void write_grid_json(cv::FileStorage& file_storage, std::string const& name, cv::Mat const& cross_locs_mat)
+{
+    file_storage << name << "{";
+    file_storage << "rows" << cross_locs_mat.rows;
+    file_storage << "cols" << cross_locs_mat.cols;
+
+    // (x, y) pairs row by row
+    file_storage << "cross_locs" << "[:";
+    for (int row = 0; row < cross_locs_mat.rows; ++row)
+    {
+        for (int col = 0; col < cross_locs_mat.cols; ++col)
+        {
+            auto const& cross_loc = cross_locs_mat.at<cv::Point>(row, col);
+            file_storage << cross_loc.x << cross_loc.y;
+        }
+    }
+    file_storage << "]";
+
+    file_storage << "}";
+}
+
+
+bool read_grid_json(cv::FileNode const& grid_node, cv::Mat& cross_locs_mat)
+{
+    auto const rows = static_cast<int>(grid_node["rows"]);
+    auto const cols = static_cast<int>(grid_node["cols"]);
+    auto const cross_locs_node = grid_node["cross_locs"];
+
+    if (rows < 0 || cols < 0 || cross_locs_node.size() != static_cast<size_t>(2 * rows * cols))
+    {
+        return false;
+    }
+
+    cross_locs_mat = rows > 0 && cols > 0 ? cv::Mat(rows, cols, CV_32SC2) : cv::Mat();
+
+    auto cross_locs_it = cross_locs_node.begin();
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int col = 0; col < cols; ++col)
+        {
+            auto& cross_loc = cross_locs_mat.at<cv::Point>(row, col);
+            cross_loc.x = static_cast<int>(*cross_locs_it);
+            ++cross_locs_it;
+            cross_loc.y = static_cast<int>(*cross_locs_it);
+            ++cross_locs_it;
+        }
+    }
+
+    return true;
+}
+
+
+void write_stage_progress_json(cv::FileStorage& file_storage, std::string const& name, StageProgress const& stage_progress)
+{
+    file_storage << name << "{";
+    file_storage << "is_completed" << static_cast<int>(stage_progress.is_completed);
+    file_storage << "found_n" << stage_progress.found_n;
+    file_storage << "holes_n" << stage_progress.holes_n;
+    file_storage << "}";
+}
+
+
+// The counts may exceed the int range of cv::FileStorage, they are written as doubles
+void write_allocation_stats_json(cv::FileStorage& file_storage, AllocationStats const& allocation_stats)
+{
+    file_storage << "allocations" << "{";
+    file_storage << "allocations_n" << static_cast<double>(allocation_stats.allocations_n);
+    file_storage << "allocated_bytes_n" << static_cast<double>(allocation_stats.allocated_bytes_n);
+    file_storage << "peak_live_bytes_n" << static_cast<double>(allocation_stats.peak_live_bytes_n);
+    file_storage << "}";
+}
+
+
+AllocationStats read_allocation_stats_json(cv::FileNode const& allocation_stats_node)
+{
+    AllocationStats allocation_stats;
+    allocation_stats.allocations_n = static_cast<int64_t>(static_cast<double>(allocation_stats_node["allocations_n"]));
+    allocation_stats.allocated_bytes_n =
+        static_cast<int64_t>(static_cast<double>(allocation_stats_node["allocated_bytes_n"]));
+    allocation_stats.peak_live_bytes_n =
+        static_cast<int64_t>(static_cast<double>(allocation_stats_node["peak_live_bytes_n"]));
+
+    return allocation_stats;
+}
+
+
+StageProgress read_stage_progress_json(cv::FileNode const& stage_progress_node)
+{
+    StageProgress stage_progress;
+    stage_progress.is_completed = static_cast<int>(stage_progress_node["is_completed"]) != 0;
+    stage_progress.found_n = static_cast<int>(stage_progress_node["found_n"]);
+    stage_progress.holes_n = static_cast<int>(stage_progress_node["holes_n"]);
+
+    return stage_progress;
+}
+
+
+void write_grid_record_json(cv::FileStorage& file_storage, GridRecord const& grid_record)
+{
+    auto const& threshold_profile = grid_record.threshold_profile;
+    auto const& detection_result = grid_record.detection_result;
+
+    file_storage << "{";
+    file_storage << "source" << grid_record.source;
+
+    file_storage << "threshold_profile" << "{";
+    file_storage << "name" << threshold_profile.name;
+    file_storage << "resize_width_height_max" << threshold_profile.resize_width_height_max;
+    file_storage << "threshold_block_size" << threshold_profile.threshold_block_size;
+    file_storage << "threshold_c" << threshold_profile.threshold_c;
+    file_storage << "}";
+
+    file_storage << "is_found" << static_cast<int>(detection_result.is_found);
+    file_storage << "is_partial" << static_cast<int>(detection_result.is_partial);
+    file_storage << "scale" << detection_result.scale;
+    file_storage << "cell_pitch" << detection_result.cell_pitch;
+
+    write_stage_progress_json(file_storage, "seed", detection_result.seed);
+    write_stage_progress_json(file_storage, "main_grid", detection_result.main_grid);
+    write_stage_progress_json(file_storage, "top_grid", detection_result.top_grid);
+    write_stage_progress_json(file_storage, "left_grid", detection_result.left_grid);
+    write_allocation_stats_json(file_storage, detection_result.allocations);
+
+    write_grid_json(file_storage, "cross_locs_main", detection_result.cross_locs_main_mat);
+    write_grid_json(file_storage, "cross_locs_top", detection_result.cross_locs_top_mat);
+    write_grid_json(file_storage, "cross_locs_left", detection_result.cross_locs_left_mat);
+    file_storage << "}";
+}
+
+
+std::pair<bool, GridRecord> read_grid_record_json(cv::FileNode const& record_node)
+{
+    GridRecord grid_record;
+    auto& threshold_profile = grid_record.threshold_profile;
+    auto& detection_result = grid_record.detection_result;
+
+    if (!record_node.isMap())
+    {
+        return std::make_pair(false, grid_record);
+    }
+
+    grid_record.source = static_cast<std::string>(record_node["source"]);
+
+    auto const profile_node = record_node["threshold_profile"];
+    threshold_profile.name = static_cast<std::string>(profile_node["name"]);
+    threshold_profile.resize_width_height_max = static_cast<float>(profile_node["resize_width_height_max"]);
+    threshold_profile.threshold_block_size = static_cast<int>(profile_node["threshold_block_size"]);
+    threshold_profile.threshold_c = static_cast<double>(profile_node["threshold_c"]);
+
+    detection_result.is_found = static_cast<int>(record_node["is_found"]) != 0;
+    detection_result.is_partial = static_cast<int>(record_node["is_partial"]) != 0;
+    detection_result.scale = static_cast<float>(record_node["scale"]);
+    detection_result.cell_pitch = static_cast<float>(record_node["cell_pitch"]);
+
+    detection_result.seed = read_stage_progress_json(record_node["seed"]);
+    detection_result.main_grid = read_stage_progress_json(record_node["main_grid"]);
+    detection_result.top_grid = read_stage_progress_json(record_node["top_grid"]);
+    detection_result.left_grid = read_stage_progress_json(record_node["left_grid"]);
+    detection_result.allocations = read_allocation_stats_json(record_node["allocations"]);
+
+    auto const grids_read =
+        read_grid_json(record_node["cross_locs_main"], detection_result.cross_locs_main_mat) &&
+        read_grid_json(record_node["cross_locs_top"], detection_result.cross_locs_top_mat) &&
+        read_grid_json(record_node["cross_locs_left"], detection_result.cross_locs_left_mat);
+
+    return std::make_pair(grids_read, grid_record);
+}
+
+
+void put_stage_progress(std::vector<unsigned char>& buffer, StageProgress const& stage_progress)
+{
+    put_varint(buffer, static_cast<uint64_t>(stage_progress.found_n));
+    put_varint(buffer, static_cast<uint64_t>(stage_progress.holes_n));
+}
+
+
+// The completion is in the record flags
+bool read_stage_progress(ByteReader& byte_reader, StageProgress& stage_progress)
+{
+    uint64_t found_n;
+    uint64_t holes_n;
+    if (!byte_reader.read_varint(found_n) || !byte_reader.read_varint(holes_n))
+    {
+        return false;
+    }
+
+    stage_progress.found_n = static_cast<int>(found_n);
+    stage_progress.holes_n = static_cast<int>(holes_n);
+
+    return true;
+}
+
+
+void put_allocation_stats(std::vector<unsigned char>& buffer, AllocationStats const& allocation_stats)
+{
+    put_varint(buffer, static_cast<uint64_t>(allocation_stats.allocations_n));
+    put_varint(buffer, static_cast<uint64_t>(allocation_stats.allocated_bytes_n));
+    put_varint(buffer, static_cast<uint64_t>(allocation_stats.peak_live_bytes_n));
+}
+
+
+bool read_allocation_stats(ByteReader& byte_reader, AllocationStats& allocation_stats)
+{
+    uint64_t allocations_n;
+    uint64_t allocated_bytes_n;
+    uint64_t peak_live_bytes_n;
+    if (!byte_reader.read_varint(allocations_n) ||
+        !byte_reader.read_varint(allocated_bytes_n) ||
+        !byte_reader.read_varint(peak_live_bytes_n))
+    {
+        return false;
+    }
+
+    allocation_stats.allocations_n = static_cast<int64_t>(allocations_n);
+    allocation_stats.allocated_bytes_n = static_cast<int64_t>(allocated_bytes_n);
+    allocation_stats.peak_live_bytes_n = static_cast<int64_t>(peak_live_bytes_n);
+
+    return true;
+}
+
+}
+
+
+std::vector<unsigned char> encode_grid_record(GridRecord const& grid_record)
+{
+    auto const& threshold_profile = grid_record.threshold_profile;
+    auto const& detection_result = grid_record.detection_result;
+
+    std::vector<unsigned char> buffer;
+
+    unsigned char flags = 0;
+    flags |= detection_result.is_found ? RECORD_FLAG_FOUND : 0;
+    flags |= detection_result.is_partial ? RECORD_FLAG_PARTIAL : 0;
+    flags |= detection_result.seed.is_completed ? RECORD_FLAG_SEED_COMPLETED : 0;
+    flags |= detection_result.main_grid.is_completed ? RECORD_FLAG_MAIN_GRID_COMPLETED : 0;
+    flags |= detection_result.top_grid.is_completed ? RECORD_FLAG_TOP_GRID_COMPLETED : 0;
+    flags |= detection_result.left_grid.is_completed ? RECORD_FLAG_LEFT_GRID_COMPLETED : 0;
+    buffer.push_back(flags);
+
+    put_stage_progress(buffer, detection_result.seed);
+    put_stage_progress(buffer, detection_result.main_grid);
+    put_stage_progress(buffer, detection_result.top_grid);
+    put_stage_progress(buffer, detection_result.left_grid);
+    put_allocation_stats(buffer, detection_result.allocations);
+
+    put_string(buffer, grid_record.source);
+    put_value(buffer, detection_result.scale);
+    put_value(buffer, detection_result.cell_pitch);
+
+    put_string(buffer, threshold_profile.name);
+    put_value(buffer, threshold_profile.resize_width_height_max);
+    put_varint_signed(buffer, threshold_profile.threshold_block_size);
+    put_value(buffer, threshold_profile.threshold_c);
+
+    put_grid(buffer, detection_result.cross_locs_main_mat);
+    put_grid(buffer, detection_result.cross_locs_top_mat);
+    put_grid(buffer, detection_result.cross_locs_left_mat);
+
+    return buffer;
+}
+
+
+std::pair<bool, GridRecord> decode_grid_record(unsigned char const* data, size_t const size)
+{
+    GridRecord grid_record;
+    auto& threshold_profile = grid_record.threshold_profile;
+    auto& detection_result = grid_record.detection_result;
+
+    ByteReader byte_reader(data, size);
+
+    unsigned char flags;
+    int64_t threshold_block_size;
+
+    auto const is_read =
+        byte_reader.read_value(flags) &&
+        read_stage_progress(byte_reader, detection_result.seed) &&
+        read_stage_progress(byte_reader, detection_result.main_grid) &&
+        read_stage_progress(byte_reader, detection_result.top_grid) &&
+        read_stage_progress(byte_reader, detection_result.left_grid) &&
+        read_allocation_stats(byte_reader, detection_result.allocations) &&
+        byte_reader.read_string(grid_record.source) &&
+        byte_reader.read_value(detection_result.scale) &&
+        byte_reader.read_value(detection_result.cell_pitch) &&
+        byte_reader.read_string(threshold_profile.name) &&
+        byte_reader.read_value(threshold_profile.resize_width_height_max) &&
+        byte_reader.read_varint_signed(threshold_block_size) &&
+        byte_reader.read_value(threshold_profile.threshold_c) &&
+        read_grid(byte_reader, detection_result.cross_locs_main_mat) &&
+        read_grid(byte_reader, detection_result.cross_locs_top_mat) &&
+        read_grid(byte_reader, detection_result.cross_locs_left_mat);
+
+    if (!is_read || byte_reader.get_size_left() != 0)
+    {
+        return std::make_pair(false, GridRecord());
+    }
+
+    detection_result.is_found = (flags & RECORD_FLAG_FOUND) != 0;
+    detection_result.is_partial = (flags & RECORD_FLAG_PARTIAL) != 0;
+    detection_result.seed.is_completed = (flags & RECORD_FLAG_SEED_COMPLETED) != 0;
+    detection_result.main_grid.is_completed = (flags & RECORD_FLAG_MAIN_GRID_COMPLETED) != 0;
+    detection_result.top_grid.is_completed = (flags & RECORD_FLAG_TOP_GRID_COMPLETED) != 0;
+    detection_result.left_grid.is_completed = (flags & RECORD_FLAG_LEFT_GRID_COMPLETED) != 0;
+
+    threshold_profile.threshold_block_size = static_cast<int>(threshold_block_size);
+
+    return std::make_pair(true, grid_record);
+}
+
+
+GridRecordWriter::GridRecordWriter()
+    : m_format(GridRecordFormat::BINARY)
+{
+}
+
+
+GridRecordWriter::~GridRecordWriter()
+{
+    close();
+}
+
+
+bool GridRecordWriter::open(std::string const& file_path, GridRecordFormat const format)
+{
+    close();
+
+    m_format = format;
+
+    if (m_format == GridRecordFormat::JSON)
+    {
+        if (!m_file_storage.open(file_path, cv::FileStorage::WRITE | cv::FileStorage::FORMAT_JSON))
+        {
+            return false;
+        }
+
+        // The sequence is closed by close()
+        m_file_storage << "records" << "[";
+
+        return true;
+    }
+
+    m_file.open(file_path, std::ios::binary);
+    if (!m_file)
+    {
+        m_file.close();
+
+        return false;
+    }
+
+    m_file.write(GRID_RECORD_MAGIC, sizeof(GRID_RECORD_MAGIC));
+    m_file.write(reinterpret_cast<char const*>(&GRID_RECORD_VERSION), sizeof(GRID_RECORD_VERSION));
+
+    return static_cast<bool>(m_file);
+}
+
+
+bool GridRecordWriter::write(GridRecord const& grid_record)
+{
+    if (!is_open())
+    {
+        return false;
+    }
+
+    if (m_format == GridRecordFormat::JSON)
+    {
+        write_grid_record_json(m_file_storage, grid_record);
+
+        return true;
+    }
+
+    auto const record_buffer = encode_grid_record(grid_record);
+
+    std::vector<unsigned char> size_buffer;
+    put_varint(size_buffer, record_buffer.size());
+
+    m_file.write(reinterpret_cast<char const*>(size_buffer.data()), static_cast<std::streamsize>(size_buffer.size()));
+    m_file.write(reinterpret_cast<char const*>(record_buffer.data()), static_cast<std::streamsize>(record_buffer.size()));
+
+    return static_cast<bool>(m_file);
+}
+
+
+bool GridRecordWriter::close()
+{
+    if (m_file_storage.isOpened())
+    {
+        m_file_storage << "]";
+        m_file_storage.release();
+    }
+
+    if (m_file.is_open())
+    {
+        m_file.close();
+
+        return static_cast<bool>(m_file);
+    }
+
+    return true;
+}
+
+
+bool GridRecordWriter::is_open() const
+{
+    return m_format == GridRecordFormat::JSON ? m_file_storage.isOpened() : m_file.is_open();
+}
+
+
+GridRecordReader::GridRecordReader()
+    : m_format(GridRecordFormat::BINARY)
+    , m_offset(0)
+{
+}
+
+
+bool GridRecordReader::open(std::string const& file_path)
+{
+    close();
+
+    if (!m_mapped_file.open(file_path))
+    {
+        return false;
+    }
+
+    auto const data = m_mapped_file.get_data();
+    auto const size = m_mapped_file.get_size();
+
+    if (size >= GRID_RECORD_HEADER_SIZE && std::memcmp(data, GRID_RECORD_MAGIC, sizeof(GRID_RECORD_MAGIC)) == 0)
+    {
+        uint32_t version;
+        std::memcpy(&version, data + sizeof(GRID_RECORD_MAGIC), sizeof(version));
+
+        if (version != GRID_RECORD_VERSION)
+        {
+            close();
+
+            return false;
+        }
+
+        m_format = GridRecordFormat::BINARY;
+        m_offset = GRID_RECORD_HEADER_SIZE;
+
+        return true;
+    }
+
+    // Anything else is expected to be the JSON written by GridRecordWriter
+    m_mapped_file.close();
+
+    if (!m_file_storage.open(file_path, cv::FileStorage::READ))
+    {
+        return false;
+    }
+
+    auto const records_node = m_file_storage["records"];
+    if (!records_node.isSeq())
+    {
+        close();
+
+        return false;
+    }
+
+    m_format = GridRecordFormat::JSON;
+    m_records_it = records_node.begin();
+    m_records_end = records_node.end();
+
+    return true;
+}
+
+
+void GridRecordReader::close()
+{
+    m_mapped_file.close();
+    m_offset = 0;
+
+    m_file_storage.release();
+    m_records_it = cv::FileNodeIterator();
+    m_records_end = cv::FileNodeIterator();
+}
+
+
+std::pair<bool, GridRecord> GridRecordReader::read()
+{
+    if (m_format == GridRecordFormat::JSON)
+    {
+        if (!m_file_storage.isOpened() || !(m_records_it != m_records_end))
+        {
+            return std::make_pair(false, GridRecord());
+        }
+
+        auto const record_node = *m_records_it;
+        ++m_records_it;
+
+        return read_grid_record_json(record_node);
+    }
+
+    if (!m_mapped_file.is_open())
+    {
+        return std::make_pair(false, GridRecord());
+    }
+
+    ByteReader byte_reader(m_mapped_file.get_data() + m_offset, m_mapped_file.get_size() - m_offset);
+
+    uint64_t record_size;
+    if (!byte_reader.read_varint(record_size) || byte_reader.get_size_left() < record_size)
+    {
+        return std::make_pair(false, GridRecord());
+    }
+
+    auto const record_offset = m_mapped_file.get_size() - byte_reader.get_size_left();
+    m_offset = record_offset + static_cast<size_t>(record_size);
+
+    return decode_grid_record(m_mapped_file.get_data() + record_offset, static_cast<size_t>(record_size));
+}
+
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+#include "image_loader.hpp"
+#include "mapped_file.hpp"
+
+namespace ng
+{
+
+std::pair<bool, cv::Size> read_jpeg_size(unsigned char const* data, size_t const size)
+{
+    size_t position = 0;
+
+    auto const read_byte = [&]()
+    {
+        return position < size ? static_cast<int>(data[position++]) : EOF;
+    };
+
+    auto const read_uint16 = [&read_byte]()
+    {
+        auto const high = read_byte();
+        auto const low = read_byte();
+
+        return high == EOF || low == EOF ? -1 : (high << 8) | low;
+    };
+
+    // Start of image
+    if (read_byte() != 0xFF || read_byte() != 0xD8)
+    {
+        return std::make_pair(false, cv::Size());
+    }
+
+    while (position < size)
+    {
+        if (read_byte() != 0xFF)
+        {
+            return std::make_pair(false, cv::Size());
+        }
+
+        // Markers may be padded with 0xFF
+        int marker;
+        do
+        {
+            marker = read_byte();
+        } while (marker == 0xFF);
+
+        if (marker == EOF)
+        {
+            break;
+        }
+
+        // Markers without a segment
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            continue;
+        }
+
+        // Start of scan or end of image, the frame header must have been before it
+        if (marker == 0xDA || marker == 0xD9)
+        {
+            break;
+        }
+
+        auto const segment_length = read_uint16();
+        if (segment_length < 2)
+        {
+            break;
+        }
+
+        // Start of frame, all but DHT, JPG and DAC among 0xC0 - 0xCF
+        bool const is_start_of_frame =
+            marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+
+        if (is_start_of_frame)
+        {
+            // Sample precision
+            read_byte();
+
+            auto const height = read_uint16();
+            auto const width = read_uint16();
+
+            if (width <= 0 || height <= 0)
+            {
+                break;
+            }
+
+            return std::make_pair(true, cv::Size(width, height));
+        }
+
+        position += segment_length - 2;
+    }
+
+    return std::make_pair(false, cv::Size());
+}
+
+
+std::pair<bool, cv::Size> read_jpeg_size(std::string const& file_path)
+{
+    MappedFile mapped_file;
+    if (!mapped_file.open(file_path))
+    {
+        return std::make_pair(false, cv::Size());
+    }
+
+    return read_jpeg_size(mapped_file.get_data(), mapped_file.get_size());
+}
+
+
+std::pair<cv::Mat, float> decode_image_reduced(
+    unsigned char const* data,
+    size_t const size,
+    float const width_height_min)
+{
+    // imdecode does not write to the buffer
+    cv::Mat const buffer(1, static_cast<int>(size), CV_8U, const_cast<unsigned char*>(data));
+
+    bool jpeg_size_found;
+    cv::Size jpeg_size;
+    std::tie(jpeg_size_found, jpeg_size) = read_jpeg_size(data, size);
+
+    if (!jpeg_size_found)
+    {
+        return std::make_pair(cv::imdecode(buffer, cv::IMREAD_GRAYSCALE), 1.0f);
+    }
+
+    std::array<std::pair<int, int>, 3> const reductions = {
+        std::make_pair(8, static_cast<int>(cv::IMREAD_REDUCED_GRAYSCALE_8)),
+        std::make_pair(4, static_cast<int>(cv::IMREAD_REDUCED_GRAYSCALE_4)),
+        std::make_pair(2, static_cast<int>(cv::IMREAD_REDUCED_GRAYSCALE_2)) };
+
+    auto const width_height_max = std::max(jpeg_size.width, jpeg_size.height);
+
+    auto flags = static_cast<int>(cv::IMREAD_GRAYSCALE);
+    for (auto const& reduction : reductions)
+    {
+        if (width_height_max / reduction.first >= width_height_min)
+        {
+            flags = reduction.second;
+
+            break;
+        }
+    }
+
+    auto image = cv::imdecode(buffer, flags);
+    if (image.empty())
+    {
+        return std::make_pair(image, 1.0f);
+    }
+
+    // The decoder rounds the reduced size up, the EXIF orientation may swap the sides
+    auto const scale = static_cast<float>(std::max(image.rows, image.cols)) / width_height_max;
+
+    return std::make_pair(image, scale);
+}
+
+
+std::pair<cv::Mat, float> load_image_reduced(std::string const& file_path, float const width_height_min)
+{
+    MappedFile mapped_file;
+    if (!mapped_file.open(file_path))
+    {
+        return std::make_pair(cv::Mat(), 1.0f);
+    }
+
+    return decode_image_reduced(mapped_file.get_data(), mapped_file.get_size(), width_height_min);
+}
+
+}
@@ -6,6 +6,7 @@
 
 #include "image_operations.hpp"
 #include "masks.hpp"
+#include "tracing.hpp"
 
 namespace ng
 {
@@ -16,6 +17,8 @@ std::pair<cv::Mat, float> resize(
     int const width_height_max_destination,
     cv::InterpolationFlags const interpolation_flag)
 {
+    NG_TRACE_SPAN(trace_span, "resize");
+
     auto const width_height_max = static_cast<float>(std::max(image.rows, image.cols));
     auto const scale = width_height_max_destination / width_height_max;
 
@@ -31,9 +34,25 @@ cv::Mat threshold(
     int const block_size,
     double const c)
 {
+    cv::Mat image_thresholded;
+    threshold(image_gray, block_size, c, image_thresholded);
+
+    return image_thresholded;
+}
+
+
+void threshold(
+    cv::Mat const& image_gray,
+    int const block_size,
+    double const c,
+    cv::Mat& image_thresholded)
+{
+    NG_TRACE_SPAN(trace_span, "threshold");
+    NG_TRACE_ARG(trace_span, "width", image_gray.cols);
+    NG_TRACE_ARG(trace_span, "height", image_gray.rows);
+
     auto const MAX_VALUE = 1;
 
-    cv::Mat image_thresholded;
     cv::adaptiveThreshold(
         image_gray,
         image_thresholded,
@@ -42,8 +61,6 @@ cv::Mat threshold(
         cv::THRESH_BINARY_INV,
         block_size,
         c);
-
-    return image_thresholded;
 }
 
 
@@ -60,8 +77,34 @@ std::pair<bool, cv::Point> find_kernel_loc(
     double const similarity_ratio_min,
     cv::Point const& anchor)
 {
-    // Convolve image with a <kernel> to get locations of the <kernel>
-    cv::Mat image_filtered;
+    bool kernel_loc_found;
+    cv::Point kernel_loc;
+    std::tie(kernel_loc_found, kernel_loc, std::ignore) = find_kernel_loc_peak(
+        image_thresholded,
+        kernel,
+        max,
+        similarity_ratio_min,
+        anchor);
+
+    return std::make_pair(kernel_loc_found, kernel_loc);
+}
+
+
+std::tuple<bool, cv::Point, double> find_kernel_loc_peak(
+    cv::Mat const& image_thresholded,
+    cv::Mat const& kernel,
+    double const max,
+    double const similarity_ratio_min,
+    cv::Point const& anchor)
+{
+    // The BFS calls it for every cross, so only a sample is recorded
+    NG_TRACE_SPAN_SAMPLED(trace_span, "find_kernel_loc", 16);
+    NG_TRACE_ARG(trace_span, "roi_width", image_thresholded.cols);
+    NG_TRACE_ARG(trace_span, "roi_height", image_thresholded.rows);
+
+    // Convolve image with a <kernel> to get locations of the <kernel>.
+    // The BFS filters windows of the same size over and over, so every thread keeps its buffer
+    thread_local cv::Mat image_filtered;
     cv::filter2D(
         image_thresholded,
         image_filtered,
@@ -78,9 +121,11 @@ std::pair<bool, cv::Point> find_kernel_loc(
     cv::Point peak_max_loc;
     cv::minMaxLoc(image_filtered, nullptr, &peak_max, nullptr, &peak_max_loc);
 
+    NG_TRACE_ARG(trace_span, "is_found", peak_max > similarity_ratio_min);
+
     return peak_max > similarity_ratio_min ?
-        std::make_pair(true, peak_max_loc) :
-        std::make_pair(false, cv::Point(-1, -1));
+        std::make_tuple(true, peak_max_loc, peak_max) :
+        std::make_tuple(false, cv::Point(-1, -1), peak_max);
 }
 
 
@@ -97,16 +142,39 @@ std::pair<bool, cv::Point> find_kernel_loc(
     double const max,
     double const similarity_ratio_min,
     cv::Point const& anchor)
+{
+    bool kernel_loc_found;
+    cv::Point kernel_loc;
+    std::tie(kernel_loc_found, kernel_loc, std::ignore) = find_kernel_loc_peak(
+        image_thresholded,
+        roi,
+        kernel,
+        max,
+        similarity_ratio_min,
+        anchor);
+
+    return std::make_pair(kernel_loc_found, kernel_loc);
+}
+
+
+std::tuple<bool, cv::Point, double> find_kernel_loc_peak(
+    cv::Mat const& image_thresholded,
+    cv::Rect const& roi,
+    cv::Mat const& kernel,
+    double const max,
+    double const similarity_ratio_min,
+    cv::Point const& anchor)
 {
     cv::Rect const image_thresholded_roi(cv::Point(0, 0), image_thresholded.size());
     if (!is_inside(image_thresholded_roi, roi))
     {
-        return std::make_pair(false, cv::Point(-1, -1));
+        return std::make_tuple(false, cv::Point(-1, -1), 0.0);
     }
 
     bool kernel_loc_found;
     cv::Point kernel_loc;
-    std::tie(kernel_loc_found, kernel_loc) = find_kernel_loc(
+    double peak_max;
+    std::tie(kernel_loc_found, kernel_loc, peak_max) = find_kernel_loc_peak(
         image_thresholded(roi),
         kernel,
         max,
@@ -114,14 +182,267 @@ std::pair<bool, cv::Point> find_kernel_loc(
         anchor);
 
     return kernel_loc_found ?
-        std::make_pair(true, kernel_loc + roi.tl()) :
-        std::make_pair(false, cv::Point(-1, -1));
+        std::make_tuple(true, kernel_loc + roi.tl(), peak_max) :
+        std::make_tuple(false, cv::Point(-1, -1), peak_max);
+}
+
+
+std::pair<cv::Mat, float> get_thumbnail_thresholded(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max)
+{
+    NG_TRACE_SPAN(trace_span, "get_thumbnail_thresholded");
+
+    auto const THRESHOLD_BLOCK_SIZE = 15;
+    auto const THRESHOLD_C = 5.0;
+
+    cv::Mat thumbnail;
+    float scale;
+    std::tie(thumbnail, scale) = resize(image, thumbnail_width_height_max, cv::INTER_AREA);
+
+    cv::Mat thumbnail_gray;
+    if (thumbnail.channels() == 3)
+    {
+        cv::cvtColor(thumbnail, thumbnail_gray, cv::COLOR_BGR2GRAY);
+    }
+    else
+    {
+        thumbnail_gray = thumbnail;
+    }
+
+    auto const thumbnail_thresholded = threshold(thumbnail_gray, THRESHOLD_BLOCK_SIZE, THRESHOLD_C);
+
+    return std::make_pair(thumbnail_thresholded, scale);
+}
+
+
+std::pair<cv::Mat, cv::Mat> get_lines(
+    cv::Mat const& image_thresholded,
+    int const line_length)
+{
+    NG_TRACE_SPAN(trace_span, "get_lines");
+
+    cv::Mat lines_horizontal;
+    cv::morphologyEx(
+        image_thresholded,
+        lines_horizontal,
+        cv::MORPH_OPEN,
+        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(line_length, 1)));
+
+    cv::Mat lines_vertical;
+    cv::morphologyEx(
+        image_thresholded,
+        lines_vertical,
+        cv::MORPH_OPEN,
+        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(1, line_length)));
+
+    return std::make_pair(lines_horizontal, lines_vertical);
+}
+
+
+std::pair<bool, cv::Rect> localize_grid(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max,
+    float const margin_ratio)
+{
+    NG_TRACE_SPAN(trace_span, "localize_grid");
+
+    auto const CROSSINGS_N_MIN = 16;
+    auto const CROSSINGS_QUANTILE = 0.02;
+
+    cv::Rect const image_roi(cv::Point(0, 0), image.size());
+
+    // Ink mask
+    cv::Mat thumbnail_thresholded;
+    float scale;
+    std::tie(thumbnail_thresholded, scale) = get_thumbnail_thresholded(image, thumbnail_width_height_max);
+
+    // Long straight strokes, text and pictures rarely survive the opening in both directions
+    auto const line_length = std::max(thumbnail_width_height_max / 25, 3);
+
+    cv::Mat lines_horizontal;
+    cv::Mat lines_vertical;
+    std::tie(lines_horizontal, lines_vertical) = get_lines(thumbnail_thresholded, line_length);
+
+    // Crossings of horizontal and vertical lines are the crosses of the grids
+    auto const kernel_dilate = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+    cv::dilate(lines_horizontal, lines_horizontal, kernel_dilate);
+    cv::dilate(lines_vertical, lines_vertical, kernel_dilate);
+
+    cv::Mat crossings;
+    cv::bitwise_and(lines_horizontal, lines_vertical, crossings);
+
+    std::vector<cv::Point> crossing_locs;
+    cv::findNonZero(crossings, crossing_locs);
+
+    if (static_cast<int>(crossing_locs.size()) < CROSSINGS_N_MIN)
+    {
+        return std::make_pair(false, image_roi);
+    }
+
+    // Quantiles instead of min and max to ignore stray crossings outside the puzzle
+    std::vector<int> xs;
+    std::vector<int> ys;
+    for (auto const& crossing_loc : crossing_locs)
+    {
+        xs.push_back(crossing_loc.x);
+        ys.push_back(crossing_loc.y);
+    }
+
+    auto const get_quantile = [](std::vector<int>& values, double const quantile)
+    {
+        auto const nth = values.begin() + static_cast<int>(quantile * (values.size() - 1));
+        std::nth_element(values.begin(), nth, values.end());
+
+        return *nth;
+    };
+
+    cv::Point const thumbnail_tl(get_quantile(xs, CROSSINGS_QUANTILE), get_quantile(ys, CROSSINGS_QUANTILE));
+    cv::Point const thumbnail_br(get_quantile(xs, 1.0 - CROSSINGS_QUANTILE), get_quantile(ys, 1.0 - CROSSINGS_QUANTILE));
+    cv::Rect const thumbnail_grid_roi(thumbnail_tl, thumbnail_br);
+
+    auto const margin_x = margin_ratio * thumbnail_grid_roi.width;
+    auto const margin_y = margin_ratio * thumbnail_grid_roi.height;
+
+    cv::Rect const grid_roi(
+        static_cast<int>((thumbnail_grid_roi.x - margin_x) / scale),
+        static_cast<int>((thumbnail_grid_roi.y - margin_y) / scale),
+        static_cast<int>((thumbnail_grid_roi.width + 2 * margin_x) / scale),
+        static_cast<int>((thumbnail_grid_roi.height + 2 * margin_y) / scale));
+
+    auto const grid_roi_cropped = grid_roi & image_roi;
+
+    return grid_roi_cropped.empty() ?
+        std::make_pair(false, image_roi) :
+        std::make_pair(true, grid_roi_cropped);
+}
+
+
+std::pair<bool, float> estimate_cell_pitch(
+    cv::Mat const& image,
+    int const thumbnail_width_height_max)
+{
+    NG_TRACE_SPAN(trace_span, "estimate_cell_pitch");
+
+    auto const PERIOD_MIN = 3;
+    auto const AUTOCORRELATION_PEAK_MIN = 0.1f;
+    auto const AUTOCORRELATION_PEAK_RATIO_MIN = 0.5f;
+
+    cv::Mat thumbnail_thresholded;
+    float scale;
+    std::tie(thumbnail_thresholded, scale) = get_thumbnail_thresholded(image, thumbnail_width_height_max);
+
+    auto const line_length = std::max(thumbnail_width_height_max / 25, 3);
+
+    cv::Mat lines_horizontal;
+    cv::Mat lines_vertical;
+    std::tie(lines_horizontal, lines_vertical) = get_lines(thumbnail_thresholded, line_length);
+
+    // The period of the line profile is the cell pitch. The thick lines every few cells
+    // give peaks at multiples of it, so the shortest strong peak is taken
+    auto const estimate_period = [&](cv::Mat const& profile)
+    {
+        auto const n = static_cast<int>(profile.total());
+        auto const mean = static_cast<float>(cv::mean(profile)[0]);
+
+        std::vector<float> values(n);
+        for (int i = 0; i < n; ++i)
+        {
+            values[i] = profile.at<float>(i) - mean;
+        }
+
+        auto const lag_max = n / 4;
+        std::vector<float> autocorrelation(lag_max + 1, 0.0f);
+        for (int lag = 0; lag <= lag_max; ++lag)
+        {
+            for (int i = 0; i + lag < n; ++i)
+            {
+                autocorrelation[lag] += values[i] * values[i + lag];
+            }
+
+            autocorrelation[lag] /= n - lag;
+        }
+
+        if (autocorrelation[0] <= 0.0f)
+        {
+            return std::make_pair(false, 0.0f);
+        }
+
+        // Skip the central peak
+        auto lag_start = 1;
+        while (lag_start < lag_max && autocorrelation[lag_start] > 0.0f)
+        {
+            ++lag_start;
+        }
+
+        lag_start = std::max(lag_start, PERIOD_MIN);
+        if (lag_start >= lag_max)
+        {
+            return std::make_pair(false, 0.0f);
+        }
+
+        auto const peak_max =
+            *std::max_element(autocorrelation.begin() + lag_start, autocorrelation.end()) / autocorrelation[0];
+        if (peak_max < AUTOCORRELATION_PEAK_MIN)
+        {
+            return std::make_pair(false, 0.0f);
+        }
+
+        for (int lag = lag_start; lag < lag_max; ++lag)
+        {
+            auto const peak = autocorrelation[lag] / autocorrelation[0];
+
+            auto const is_local_max =
+                autocorrelation[lag] >= autocorrelation[lag - 1] && autocorrelation[lag] >= autocorrelation[lag + 1];
+
+            if (is_local_max && peak >= AUTOCORRELATION_PEAK_RATIO_MIN * peak_max)
+            {
+                return std::make_pair(true, static_cast<float>(lag));
+            }
+        }
+
+        return std::make_pair(false, 0.0f);
+    };
+
+    // Vertical lines repeat along x, horizontal lines along y
+    cv::Mat profile_x;
+    cv::reduce(lines_vertical, profile_x, 0, cv::REDUCE_SUM, CV_32F);
+
+    cv::Mat profile_y;
+    cv::reduce(lines_horizontal, profile_y, 1, cv::REDUCE_SUM, CV_32F);
+
+    bool period_x_found;
+    float period_x;
+    std::tie(period_x_found, period_x) = estimate_period(profile_x);
+
+    bool period_y_found;
+    float period_y;
+    std::tie(period_y_found, period_y) = estimate_period(profile_y);
+
+    if (!period_x_found && !period_y_found)
+    {
+        return std::make_pair(false, 0.0f);
+    }
+
+    auto const period =
+        period_x_found && period_y_found ? (period_x + period_y) / 2.0f :
+        period_x_found ? period_x : period_y;
+
+    return std::make_pair(true, period / scale);
 }
 
 
 std::vector<std::vector<cv::Mat>> get_cell_warped_images_vector(cv::Mat const& image, cv::Mat const& cross_locs)
 {
-    std::cout << cross_locs.size() << std::endl;
+    NG_TRACE_SPAN(trace_span, "get_cell_warped_images_vector");
+    NG_TRACE_ARG(trace_span, "rows", cross_locs.rows);
+    NG_TRACE_ARG(trace_span, "cols", cross_locs.cols);
+
+    // A grid which was not found has no cells
+    if (cross_locs.rows < 2 || cross_locs.cols < 2)
+    {
+        return std::vector<std::vector<cv::Mat>>();
+    }
 
     auto const cell_warped_side_length = 20;
     cv::Size const cell_warped_size(cell_warped_side_length, cell_warped_side_length);
@@ -0,0 +1,188 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ng
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : m_file_handle(INVALID_HANDLE_VALUE)
+    , m_mapping_handle(nullptr)
+    , m_data(nullptr)
+    , m_size(0)
+{
+}
+
+
+bool MappedFile::open(std::string const& file_path)
+{
+    close();
+
+    m_file_handle = CreateFileA(
+        file_path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+
+    if (m_file_handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(m_file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        close();
+
+        return false;
+    }
+
+    m_mapping_handle = CreateFileMappingA(m_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping_handle == nullptr)
+    {
+        close();
+
+        return false;
+    }
+
+    m_data = MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == nullptr)
+    {
+        close();
+
+        return false;
+    }
+
+    m_size = static_cast<size_t>(file_size.QuadPart);
+
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        UnmapViewOfFile(m_data);
+    }
+
+    if (m_mapping_handle != nullptr)
+    {
+        CloseHandle(m_mapping_handle);
+    }
+
+    if (m_file_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file_handle);
+    }
+
+    m_file_handle = INVALID_HANDLE_VALUE;
+    m_mapping_handle = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : m_file_descriptor(-1)
+    , m_data(nullptr)
+    , m_size(0)
+{
+}
+
+
+bool MappedFile::open(std::string const& file_path)
+{
+    close();
+
+    m_file_descriptor = ::open(file_path.c_str(), O_RDONLY);
+    if (m_file_descriptor == -1)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(m_file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close();
+
+        return false;
+    }
+
+    auto const size = static_cast<size_t>(file_stat.st_size);
+
+    auto const data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, m_file_descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+
+        return false;
+    }
+
+    // The file is read once from the start, e.g. by a decoder
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    m_data = data;
+    m_size = size;
+
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        munmap(m_data, m_size);
+    }
+
+    if (m_file_descriptor != -1)
+    {
+        ::close(m_file_descriptor);
+    }
+
+    m_file_descriptor = -1;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::is_open() const
+{
+    return m_data != nullptr;
+}
+
+
+unsigned char const* MappedFile::get_data() const
+{
+    return static_cast<unsigned char const*>(m_data);
+}
+
+
+size_t MappedFile::get_size() const
+{
+    return m_size;
+}
+
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "masks.hpp"
 
 namespace ng
@@ -47,4 +49,46 @@ std::pair<cv::Mat, int> get_mask_cross(int const length)
     return std::make_pair(mask_cross, mask_cross_perimeter);
 }
 
+std::pair<cv::Mat, int> get_mask_cross_main(int const cell_side_length)
+{
+    auto const mask_length = static_cast<int>(cell_side_length * 1.5f);
+    auto const mask_length_odd = mask_length / 2 * 2 + 1;
+
+    auto const line_width = static_cast<int>(cell_side_length / 4);
+    auto const line_width_half = line_width / 2;
+
+    return get_mask_cross(mask_length_odd, line_width_half);
+}
+
+std::pair<cv::Mat, int> get_mask_cross_thick(int const cell_side_length, int const line_width)
+{
+    auto const mask_length = static_cast<int>(cell_side_length * 1.5f);
+    auto const mask_length_odd = mask_length / 2 * 2 + 1;
+    auto const length_half = mask_length_odd / 2;
+
+    // The band is odd to stay centered and not wider than the line
+    auto const line_width_half = std::min(std::max(line_width - 1, 0) / 2, length_half);
+    auto const band_width = 2 * line_width_half + 1;
+    auto const margin = std::min(line_width_half + cell_side_length / 8, length_half);
+
+    cv::Mat mask_cross = (-1) * cv::Mat::ones(mask_length_odd, mask_length_odd, CV_32S);
+
+    mask_cross(cv::Rect(length_half - margin, 0, 2 * margin + 1, mask_length_odd)) = 0;
+    mask_cross(cv::Rect(0, length_half - margin, mask_length_odd, 2 * margin + 1)) = 0;
+
+    mask_cross(cv::Rect(length_half - line_width_half, 0, band_width, mask_length_odd)) = 1;
+    mask_cross(cv::Rect(0, length_half - line_width_half, mask_length_odd, band_width)) = 1;
+
+    auto const mask_cross_perimeter = 2 * mask_length_odd * band_width - band_width * band_width;
+
+    return std::make_pair(mask_cross, mask_cross_perimeter);
+}
+
+std::pair<cv::Mat, int> get_mask_cross_clues(int const cell_side_length)
+{
+    auto const cell_side_length_odd = cell_side_length / 2 * 2 + 1;
+
+    return get_mask_cross(cell_side_length_odd);
+}
+
 }
\ No newline at end of file
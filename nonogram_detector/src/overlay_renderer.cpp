@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include "overlay_renderer.hpp"
+
+namespace ng
+{
+
+OverlayRenderer::OverlayRenderer(
+    int const output_width_height_max,
+    OverlayStyle const& main_style,
+    OverlayStyle const& top_style,
+    OverlayStyle const& left_style)
+    : M_OUTPUT_WIDTH_HEIGHT_MAX(output_width_height_max)
+    , M_MAIN_STYLE(main_style)
+    , M_TOP_STYLE(top_style)
+    , M_LEFT_STYLE(left_style)
+    , m_scale(1.0f)
+{
+}
+
+
+void OverlayRenderer::set_image(cv::Mat const& image)
+{
+    auto const width_height_max = std::max(image.rows, image.cols);
+    m_scale = M_OUTPUT_WIDTH_HEIGHT_MAX > 0 && width_height_max > M_OUTPUT_WIDTH_HEIGHT_MAX ?
+        static_cast<float>(M_OUTPUT_WIDTH_HEIGHT_MAX) / width_height_max :
+        1.0f;
+
+    cv::Mat image_resized;
+    if (m_scale < 1.0f)
+    {
+        cv::resize(image, image_resized, cv::Size(), m_scale, m_scale, cv::INTER_AREA);
+    }
+    else
+    {
+        image_resized = image;
+    }
+
+    // The layers are colored
+    if (image_resized.channels() == 1)
+    {
+        cv::cvtColor(image_resized, m_background, cv::COLOR_GRAY2BGR);
+    }
+    else
+    {
+        image_resized.copyTo(m_background);
+    }
+}
+
+
+cv::Mat const& OverlayRenderer::render(
+    cv::Mat const& cross_locs_main_mat,
+    cv::Mat const& cross_locs_top_mat,
+    cv::Mat const& cross_locs_left_mat)
+{
+    // Reuses the memory of the previous output of the same size
+    m_background.copyTo(m_output);
+
+    draw(cross_locs_main_mat, M_MAIN_STYLE);
+    draw(cross_locs_top_mat, M_TOP_STYLE);
+    draw(cross_locs_left_mat, M_LEFT_STYLE);
+
+    return m_output;
+}
+
+
+cv::Mat const& OverlayRenderer::render(
+    cv::Mat const& image,
+    cv::Mat const& cross_locs_main_mat,
+    cv::Mat const& cross_locs_top_mat,
+    cv::Mat const& cross_locs_left_mat)
+{
+    set_image(image);
+
+    return render(cross_locs_main_mat, cross_locs_top_mat, cross_locs_left_mat);
+}
+
+
+float OverlayRenderer::get_scale() const
+{
+    return m_scale;
+}
+
+
+OverlayStyle OverlayRenderer::get_style(cv::Scalar const& color)
+{
+    OverlayStyle style;
+    style.color = color;
+
+    return style;
+}
+
+
+void OverlayRenderer::draw(cv::Mat const& cross_locs_mat, OverlayStyle const& style)
+{
+    if (cross_locs_mat.empty() || !style.is_visible)
+    {
+        return;
+    }
+
+    std::for_each(
+        cross_locs_mat.begin<cv::Point>(),
+        cross_locs_mat.end<cv::Point>(),
+        [&](cv::Point const& cross_loc)
+        {
+            if (cross_loc == cv::Point(-1, -1))
+            {
+                return;
+            }
+
+            cv::Point const cross_loc_scaled(cvRound(m_scale * cross_loc.x), cvRound(m_scale * cross_loc.y));
+
+            cv::circle(m_output, cross_loc_scaled, style.radius, style.color, style.thickness);
+        });
+}
+
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <string>
+
+#include "synthetic_puzzle.hpp"
+
+namespace ng
+{
+
+SyntheticPuzzle generate_synthetic_puzzle(
+    cv::RNG& rng,
+    int const rows,
+    int const cols,
+    int const cell_side_length,
+    float const perspective_jitter_ratio)
+{
+    auto const CLUES_N = 6;
+    auto const MARGIN = 2 * cell_side_length;
+
+    auto const line_width = std::max(cell_side_length / 16, 1);
+    auto const line_width_thick = 2 * line_width + 1;
+
+    cv::Point const main_tl(MARGIN + CLUES_N * cell_side_length, MARGIN + CLUES_N * cell_side_length);
+    cv::Size const image_size(
+        main_tl.x + cols * cell_side_length + MARGIN,
+        main_tl.y + rows * cell_side_length + MARGIN);
+
+    cv::Mat image(image_size, CV_8U, cv::Scalar(255));
+
+    // The lines of the clue grids continue the lines of the main grid
+    for (int col = 0; col <= cols; ++col)
+    {
+        auto const x = main_tl.x + col * cell_side_length;
+        auto const width = col % 5 == 0 || col == cols ? line_width_thick : line_width;
+
+        cv::line(
+            image,
+            cv::Point(x, main_tl.y - CLUES_N * cell_side_length),
+            cv::Point(x, main_tl.y + rows * cell_side_length),
+            cv::Scalar(0),
+            width);
+    }
+
+    for (int row = 0; row <= rows; ++row)
+    {
+        auto const y = main_tl.y + row * cell_side_length;
+        auto const width = row % 5 == 0 || row == rows ? line_width_thick : line_width;
+
+        cv::line(
+            image,
+            cv::Point(main_tl.x - CLUES_N * cell_side_length, y),
+            cv::Point(main_tl.x + cols * cell_side_length, y),
+            cv::Scalar(0),
+            width);
+    }
+
+    for (int clue = 1; clue <= CLUES_N; ++clue)
+    {
+        cv::line(
+            image,
+            cv::Point(main_tl.x, main_tl.y - clue * cell_side_length),
+            cv::Point(main_tl.x + cols * cell_side_length, main_tl.y - clue * cell_side_length),
+            cv::Scalar(0),
+            line_width);
+
+        cv::line(
+            image,
+            cv::Point(main_tl.x - clue * cell_side_length, main_tl.y),
+            cv::Point(main_tl.x - clue * cell_side_length, main_tl.y + rows * cell_side_length),
+            cv::Scalar(0),
+            line_width);
+    }
+
+    // Clue numbers fill the cells next to the main grid
+    auto const font_scale = cell_side_length / 40.0;
+    auto const draw_clue = [&](cv::Point const& cell_tl)
+    {
+        cv::putText(
+            image,
+            std::to_string(rng.uniform(1, 10)),
+            cell_tl + cv::Point(cell_side_length / 4, 3 * cell_side_length / 4),
+            cv::FONT_HERSHEY_SIMPLEX,
+            font_scale,
+            cv::Scalar(0),
+            line_width);
+    };
+
+    for (int col = 0; col < cols; ++col)
+    {
+        auto const clues_n = rng.uniform(1, CLUES_N + 1);
+        for (int clue = 1; clue <= clues_n; ++clue)
+        {
+            draw_clue(main_tl + cv::Point(col * cell_side_length, -clue * cell_side_length));
+        }
+    }
+
+    for (int row = 0; row < rows; ++row)
+    {
+        auto const clues_n = rng.uniform(1, CLUES_N + 1);
+        for (int clue = 1; clue <= clues_n; ++clue)
+        {
+            draw_clue(main_tl + cv::Point(-clue * cell_side_length, row * cell_side_length));
+        }
+    }
+
+    // A photo of a page which is not quite flat
+    auto const jitter = perspective_jitter_ratio * std::min(image_size.width, image_size.height);
+
+    std::vector<cv::Point2f> const corners = {
+        cv::Point2f(0.0f, 0.0f),
+        cv::Point2f(static_cast<float>(image_size.width), 0.0f),
+        cv::Point2f(static_cast<float>(image_size.width), static_cast<float>(image_size.height)),
+        cv::Point2f(0.0f, static_cast<float>(image_size.height)) };
+
+    std::vector<cv::Point2f> corners_warped;
+    for (auto const& corner : corners)
+    {
+        corners_warped.push_back(corner + cv::Point2f(rng.uniform(-jitter, jitter), rng.uniform(-jitter, jitter)));
+    }
+
+    auto const warp_matrix = cv::getPerspectiveTransform(corners, corners_warped);
+
+    SyntheticPuzzle synthetic_puzzle;
+    cv::warpPerspective(
+        image,
+        synthetic_puzzle.image,
+        warp_matrix,
+        image_size,
+        cv::INTER_LINEAR,
+        cv::BORDER_CONSTANT,
+        cv::Scalar(255));
+
+    cv::GaussianBlur(synthetic_puzzle.image, synthetic_puzzle.image, cv::Size(3, 3), 0.0);
+
+    cv::Mat noise(image_size, CV_16S);
+    rng.fill(noise, cv::RNG::NORMAL, 0.0, 8.0);
+
+    cv::Mat image_noisy;
+    synthetic_puzzle.image.convertTo(image_noisy, CV_16S);
+    image_noisy += noise;
+    image_noisy.convertTo(synthetic_puzzle.image, CV_8U);
+
+    std::vector<cv::Point2f> cross_locs;
+    for (int row = 0; row <= rows; ++row)
+    {
+        for (int col = 0; col <= cols; ++col)
+        {
+            cross_locs.push_back(cv::Point2f(main_tl + cv::Point(col * cell_side_length, row * cell_side_length)));
+        }
+    }
+
+    std::vector<cv::Point2f> cross_locs_warped;
+    cv::perspectiveTransform(cross_locs, cross_locs_warped, warp_matrix);
+
+    synthetic_puzzle.cross_locs_main_mat = cv::Mat(rows + 1, cols + 1, CV_32FC2);
+    for (int i = 0; i < static_cast<int>(cross_locs_warped.size()); ++i)
+    {
+        synthetic_puzzle.cross_locs_main_mat.at<cv::Point2f>(i / (cols + 1), i % (cols + 1)) = cross_locs_warped[i];
+    }
+
+    return synthetic_puzzle;
+}
+
+
+std::vector<SyntheticPuzzle> generate_synthetic_puzzles(
+    int const puzzles_n,
+    uint64_t const seed,
+    float const perspective_jitter_ratio)
+{
+    cv::RNG rng(seed);
+
+    std::vector<SyntheticPuzzle> synthetic_puzzles;
+    for (int i = 0; i < puzzles_n; ++i)
+    {
+        auto const rows = 5 * rng.uniform(2, 7);
+        auto const cols = 5 * rng.uniform(2, 7);
+        auto const cell_side_length = rng.uniform(18, 40);
+
+        synthetic_puzzles.push_back(
+            generate_synthetic_puzzle(rng, rows, cols, cell_side_length, perspective_jitter_ratio));
+    }
+
+    return synthetic_puzzles;
+}
+
+}
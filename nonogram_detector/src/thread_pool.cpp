@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+#include "tracing.hpp"
+
+namespace ng
+{
+
+ThreadPool::ThreadPool(int const workers_n, int const queue_capacity)
+    : M_QUEUE_CAPACITY(std::max(queue_capacity, 1))
+    , m_is_stopping(false)
+    , m_busy_workers_n(0)
+{
+    for (int worker_index = 0; worker_index < std::max(workers_n, 1); ++worker_index)
+    {
+        m_workers.emplace_back(&ThreadPool::run, this, worker_index);
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopping = true;
+    }
+
+    m_queue_not_empty.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+
+void ThreadPool::submit(std::function<void(int)> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue_not_full.wait(lock, [this]() { return static_cast<int>(m_queue.size()) < M_QUEUE_CAPACITY; });
+
+        m_queue.push_back(std::move(task));
+    }
+
+    m_queue_not_empty.notify_one();
+}
+
+
+bool ThreadPool::try_submit(std::function<void(int)> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (static_cast<int>(m_queue.size()) >= M_QUEUE_CAPACITY)
+        {
+            return false;
+        }
+
+        m_queue.push_back(std::move(task));
+    }
+
+    m_queue_not_empty.notify_one();
+
+    return true;
+}
+
+
+int ThreadPool::get_workers_n() const
+{
+    return static_cast<int>(m_workers.size());
+}
+
+
+int ThreadPool::get_queue_depth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return static_cast<int>(m_queue.size());
+}
+
+
+int ThreadPool::get_busy_workers_n() const
+{
+    return m_busy_workers_n.load();
+}
+
+
+void ThreadPool::run(int const worker_index)
+{
+    while (true)
+    {
+        std::function<void(int)> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queue_not_empty.wait(lock, [this]() { return m_is_stopping || !m_queue.empty(); });
+
+            if (m_queue.empty())
+            {
+                return;
+            }
+
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+
+            ++m_busy_workers_n;
+        }
+
+        m_queue_not_full.notify_one();
+
+        {
+            NG_TRACE_SPAN(trace_span, "thread_pool_task");
+            task(worker_index);
+        }
+
+        --m_busy_workers_n;
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "threshold_profile.hpp"
+
+namespace ng
+{
+
+bool save_threshold_profiles(
+    std::string const& file_path,
+    std::vector<ThresholdProfile> const& threshold_profiles)
+{
+    cv::FileStorage file_storage(file_path, cv::FileStorage::WRITE);
+    if (!file_storage.isOpened())
+    {
+        return false;
+    }
+
+    file_storage << "profiles" << "[";
+    for (auto const& threshold_profile : threshold_profiles)
+    {
+        file_storage << "{";
+        file_storage << "name" << threshold_profile.name;
+        file_storage << "resize_width_height_max" << threshold_profile.resize_width_height_max;
+        file_storage << "threshold_block_size" << threshold_profile.threshold_block_size;
+        file_storage << "threshold_c" << threshold_profile.threshold_c;
+        file_storage << "}";
+    }
+    file_storage << "]";
+
+    return true;
+}
+
+
+std::pair<bool, std::vector<ThresholdProfile>> load_threshold_profiles(std::string const& file_path)
+{
+    std::vector<ThresholdProfile> threshold_profiles;
+
+    cv::FileStorage file_storage(file_path, cv::FileStorage::READ);
+    if (!file_storage.isOpened())
+    {
+        return std::make_pair(false, threshold_profiles);
+    }
+
+    auto const profiles_node = file_storage["profiles"];
+    if (!profiles_node.isSeq())
+    {
+        return std::make_pair(false, threshold_profiles);
+    }
+
+    for (auto const& profile_node : profiles_node)
+    {
+        ThresholdProfile threshold_profile;
+        threshold_profile.name = static_cast<std::string>(profile_node["name"]);
+        threshold_profile.resize_width_height_max = static_cast<float>(profile_node["resize_width_height_max"]);
+        threshold_profile.threshold_block_size = static_cast<int>(profile_node["threshold_block_size"]);
+        threshold_profile.threshold_c = static_cast<double>(profile_node["threshold_c"]);
+
+        threshold_profiles.push_back(threshold_profile);
+    }
+
+    return std::make_pair(true, threshold_profiles);
+}
+
+
+std::pair<bool, ThresholdProfile> load_threshold_profile(
+    std::string const& file_path,
+    std::string const& name)
+{
+    bool threshold_profiles_loaded;
+    std::vector<ThresholdProfile> threshold_profiles;
+    std::tie(threshold_profiles_loaded, threshold_profiles) = load_threshold_profiles(file_path);
+
+    auto const threshold_profile_it = std::find_if(
+        threshold_profiles.begin(),
+        threshold_profiles.end(),
+        [&name](ThresholdProfile const& threshold_profile)
+        {
+            return threshold_profile.name == name;
+        });
+
+    return threshold_profile_it != threshold_profiles.end() ?
+        std::make_pair(true, *threshold_profile_it) :
+        std::make_pair(false, ThresholdProfile());
+}
+
+
+void upsert_threshold_profile(
+    std::vector<ThresholdProfile>& threshold_profiles,
+    ThresholdProfile const& threshold_profile)
+{
+    auto const threshold_profile_it = std::find_if(
+        threshold_profiles.begin(),
+        threshold_profiles.end(),
+        [&threshold_profile](ThresholdProfile const& threshold_profile_other)
+        {
+            return threshold_profile_other.name == threshold_profile.name;
+        });
+
+    if (threshold_profile_it != threshold_profiles.end())
+    {
+        *threshold_profile_it = threshold_profile;
+    }
+    else
+    {
+        threshold_profiles.push_back(threshold_profile);
+    }
+}
+
+}
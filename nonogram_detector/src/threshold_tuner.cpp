@@ -0,0 +1,242 @@
+#include <algorithm>
+
+#include "cross_locs_detector.hpp"
+#include "thread_pool.hpp"
+#include "threshold_tuner.hpp"
+
+namespace ng
+{
+
+double const ThresholdTuner::IRREGULARITY_RATIO_MAX = 0.25;
+
+
+ThresholdTuner::ThresholdTuner(
+    int const find_cell_side_length_min,
+    int const find_cell_side_length_max,
+    double const similarity_ratio_min,
+    DetectionOptions const& options,
+    int const workers_n)
+    : M_FIND_CELL_SIDE_LENGTH_MIN(find_cell_side_length_min)
+    , M_FIND_CELL_SIDE_LENGTH_MAX(find_cell_side_length_max)
+    , M_SIMILARITY_RATIO_MIN(similarity_ratio_min)
+    , M_OPTIONS(options)
+    , M_WORKERS_N(std::max(workers_n, 1))
+{
+}
+
+
+std::tuple<bool, ThresholdProfile, double> ThresholdTuner::tune(
+    std::string const& name,
+    std::vector<cv::Mat> const& images,
+    ThresholdCandidates const& threshold_candidates,
+    Deadline const& deadline) const
+{
+    auto const threshold_profiles = get_threshold_profiles(name, threshold_candidates);
+
+    if (threshold_profiles.empty() || images.empty())
+    {
+        return std::make_tuple(false, ThresholdProfile(), 0.0);
+    }
+
+    // Every task writes only its own evaluation, the pool joins the workers before they are read
+    struct Evaluation
+    {
+        bool is_found = false;
+
+        // Crosses of the main grid found by the search, before augment pads and interpolates the grid
+        int found_n = 0;
+        int holes_n = 0;
+        bool irregularity_found = false;
+        double irregularity = 0.0;
+    };
+
+    std::vector<Evaluation> evaluations(threshold_profiles.size() * images.size());
+
+    {
+        ThreadPool thread_pool(M_WORKERS_N, 2 * M_WORKERS_N);
+
+        for (int i = 0; i < threshold_profiles.size(); ++i)
+        {
+            for (int j = 0; j < images.size(); ++j)
+            {
+                thread_pool.submit([&, i, j](int const)
+                {
+                    if (deadline.is_expired())
+                    {
+                        return;
+                    }
+
+                    CrossLocsDetector cross_locs_detector(
+                        threshold_profiles[i],
+                        M_FIND_CELL_SIDE_LENGTH_MIN,
+                        M_FIND_CELL_SIDE_LENGTH_MAX,
+                        M_SIMILARITY_RATIO_MIN,
+                        M_OPTIONS);
+
+                    DetectionResult detection_result;
+                    try
+                    {
+                        detection_result = cross_locs_detector.detect(images[j], deadline);
+                    }
+                    catch (cv::Exception const&)
+                    {
+                        // The candidate does not suit the image, e.g. the block size is larger than it
+                        return;
+                    }
+
+                    auto& evaluation = evaluations[i * images.size() + j];
+                    evaluation.is_found = detection_result.is_found && !detection_result.is_partial;
+                    evaluation.found_n = detection_result.main_grid.found_n;
+                    evaluation.holes_n = detection_result.main_grid.holes_n;
+                    std::tie(evaluation.irregularity_found, evaluation.irregularity) =
+                        get_irregularity(detection_result.cross_locs_main_mat);
+                });
+            }
+        }
+    }
+
+    // The grid size is only comparable between the candidates on the same image
+    std::vector<int> found_n_max(images.size(), 0);
+    for (int i = 0; i < threshold_profiles.size(); ++i)
+    {
+        for (int j = 0; j < images.size(); ++j)
+        {
+            auto const& evaluation = evaluations[i * images.size() + j];
+            if (evaluation.is_found)
+            {
+                found_n_max[j] = std::max(found_n_max[j], evaluation.found_n);
+            }
+        }
+    }
+
+    bool threshold_profile_best_found = false;
+    int threshold_profile_best_index = 0;
+    double score_best = 0.0;
+
+    for (int i = 0; i < threshold_profiles.size(); ++i)
+    {
+        double score = 0.0;
+
+        for (int j = 0; j < images.size(); ++j)
+        {
+            auto const& evaluation = evaluations[i * images.size() + j];
+            if (!evaluation.is_found || evaluation.found_n == 0)
+            {
+                continue;
+            }
+
+            auto const size_ratio = static_cast<double>(evaluation.found_n) / found_n_max[j];
+            // The holes are the crosses inside the grid the search did not find
+            auto const completeness =
+                static_cast<double>(evaluation.found_n) / (evaluation.found_n + evaluation.holes_n);
+            auto const regularity = evaluation.irregularity_found ?
+                std::max(0.0, 1.0 - evaluation.irregularity / IRREGULARITY_RATIO_MAX) :
+                0.0;
+
+            // Each term is from 0 to 1, finding the seed at all counts as much as each metric of the grid
+            score += 1.0 + size_ratio + completeness + regularity;
+        }
+
+        score /= images.size();
+
+        if (score > score_best)
+        {
+            threshold_profile_best_found = true;
+            threshold_profile_best_index = i;
+            score_best = score;
+        }
+    }
+
+    return std::make_tuple(
+        threshold_profile_best_found,
+        threshold_profiles[threshold_profile_best_index],
+        score_best);
+}
+
+
+std::vector<ThresholdProfile> ThresholdTuner::get_threshold_profiles(
+    std::string const& name,
+    ThresholdCandidates const& threshold_candidates)
+{
+    std::vector<ThresholdProfile> threshold_profiles;
+
+    for (auto const resize_width_height_max : threshold_candidates.resize_width_height_max_values)
+    {
+        for (auto const threshold_block_size : threshold_candidates.threshold_block_size_values)
+        {
+            // Adaptive threshold needs an odd block size larger than 1
+            if (threshold_block_size < 3 || threshold_block_size % 2 == 0)
+            {
+                continue;
+            }
+
+            for (auto const threshold_c : threshold_candidates.threshold_c_values)
+            {
+                ThresholdProfile threshold_profile;
+                threshold_profile.name = name;
+                threshold_profile.resize_width_height_max = resize_width_height_max;
+                threshold_profile.threshold_block_size = threshold_block_size;
+                threshold_profile.threshold_c = threshold_c;
+
+                threshold_profiles.push_back(threshold_profile);
+            }
+        }
+    }
+
+    return threshold_profiles;
+}
+
+
+std::pair<bool, double> ThresholdTuner::get_irregularity(cv::Mat const& cross_locs_mat)
+{
+    double deviation_sum = 0.0;
+    double cell_side_length_sum = 0.0;
+    int crosses_n = 0;
+
+    auto const is_valid = [&cross_locs_mat](int const y, int const x)
+    {
+        return cross_locs_mat.at<cv::Point>(y, x) != cv::Point(-1, -1);
+    };
+
+    for (int y = 1; y + 1 < cross_locs_mat.rows; ++y)
+    {
+        for (int x = 1; x + 1 < cross_locs_mat.cols; ++x)
+        {
+            if (!is_valid(y, x))
+            {
+                continue;
+            }
+
+            cv::Point2d const cross_loc(cross_locs_mat.at<cv::Point>(y, x));
+
+            std::vector<std::pair<cv::Point, cv::Point>> const neighbor_pairs = {
+                std::make_pair(cv::Point(x - 1, y), cv::Point(x + 1, y)),
+                std::make_pair(cv::Point(x, y - 1), cv::Point(x, y + 1)) };
+
+            for (auto const& neighbor_pair : neighbor_pairs)
+            {
+                if (!is_valid(neighbor_pair.first.y, neighbor_pair.first.x) ||
+                    !is_valid(neighbor_pair.second.y, neighbor_pair.second.x))
+                {
+                    continue;
+                }
+
+                cv::Point2d const cross_loc_1(cross_locs_mat.at<cv::Point>(neighbor_pair.first));
+                cv::Point2d const cross_loc_2(cross_locs_mat.at<cv::Point>(neighbor_pair.second));
+
+                deviation_sum += cv::norm(cross_loc_1 + cross_loc_2 - 2.0 * cross_loc) / 2.0;
+                cell_side_length_sum += cv::norm(cross_loc_2 - cross_loc_1) / 2.0;
+                ++crosses_n;
+            }
+        }
+    }
+
+    if (crosses_n == 0 || cell_side_length_sum <= 0.0)
+    {
+        return std::make_pair(false, 0.0);
+    }
+
+    return std::make_pair(true, deviation_sum / cell_side_length_sum);
+}
+
+}
@@ -0,0 +1,197 @@
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tracing.hpp"
+
+namespace ng
+{
+
+namespace
+{
+
+struct TraceEvent
+{
+    char const* name;
+    int64_t start_us;
+    int64_t duration_us;
+    int thread_id;
+
+    std::array<std::pair<char const*, double>, TraceSpan::ARGS_N_MAX> args;
+    int args_n;
+};
+
+
+// Every thread appends to its own buffer, the lock is only contended while the trace is written
+struct ThreadTraceBuffer
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+};
+
+
+std::atomic<bool> g_is_tracing(false);
+
+std::mutex g_thread_trace_buffers_mutex;
+std::vector<std::shared_ptr<ThreadTraceBuffer>> g_thread_trace_buffers;
+
+// Read by the spans without the lock
+std::atomic<int64_t> g_tracing_start_us(0);
+
+std::atomic<int> g_thread_id_next(1);
+
+
+ThreadTraceBuffer& get_thread_trace_buffer()
+{
+    thread_local std::shared_ptr<ThreadTraceBuffer> thread_trace_buffer;
+
+    if (!thread_trace_buffer)
+    {
+        thread_trace_buffer = std::make_shared<ThreadTraceBuffer>();
+
+        std::lock_guard<std::mutex> lock(g_thread_trace_buffers_mutex);
+        g_thread_trace_buffers.push_back(thread_trace_buffer);
+    }
+
+    return *thread_trace_buffer;
+}
+
+
+int64_t get_time_us(std::chrono::steady_clock::time_point const& time_point)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count();
+}
+
+
+// Small numbers are easier to read in the trace viewer than the native thread ids
+int get_thread_id()
+{
+    thread_local int const thread_id = g_thread_id_next++;
+
+    return thread_id;
+}
+
+}
+
+
+void start_tracing()
+{
+    std::lock_guard<std::mutex> lock(g_thread_trace_buffers_mutex);
+
+    for (auto const& thread_trace_buffer : g_thread_trace_buffers)
+    {
+        std::lock_guard<std::mutex> buffer_lock(thread_trace_buffer->mutex);
+        thread_trace_buffer->events.clear();
+    }
+
+    g_tracing_start_us = get_time_us(std::chrono::steady_clock::now());
+    g_is_tracing = true;
+}
+
+
+void stop_tracing()
+{
+    g_is_tracing = false;
+}
+
+
+bool is_tracing()
+{
+    return g_is_tracing.load(std::memory_order_relaxed);
+}
+
+
+bool write_chrome_trace(std::string const& file_path)
+{
+    std::ofstream file(file_path);
+    if (!file)
+    {
+        return false;
+    }
+
+    // The names and the keys are identifiers, they need no escaping
+    file << "{\"traceEvents\":[";
+
+    auto is_first = true;
+
+    std::lock_guard<std::mutex> lock(g_thread_trace_buffers_mutex);
+
+    for (auto const& thread_trace_buffer : g_thread_trace_buffers)
+    {
+        std::lock_guard<std::mutex> buffer_lock(thread_trace_buffer->mutex);
+
+        for (auto const& event : thread_trace_buffer->events)
+        {
+            file << (is_first ? "\n" : ",\n");
+            is_first = false;
+
+            file
+                << "{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+                << ",\"ts\":" << event.start_us
+                << ",\"dur\":" << event.duration_us
+                << ",\"pid\":1,\"tid\":" << event.thread_id
+                << ",\"args\":{";
+
+            for (int i = 0; i < event.args_n; ++i)
+            {
+                file << (i > 0 ? "," : "") << "\"" << event.args[i].first << "\":" << event.args[i].second;
+            }
+
+            file << "}}";
+        }
+    }
+
+    file << "\n]}\n";
+
+    return static_cast<bool>(file);
+}
+
+
+TraceSpan::TraceSpan(char const* name, bool const is_sampled)
+    : m_name(name)
+    , m_is_recording(is_sampled && is_tracing())
+    , m_args_n(0)
+{
+    if (m_is_recording)
+    {
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+
+TraceSpan::~TraceSpan()
+{
+    if (!m_is_recording)
+    {
+        return;
+    }
+
+    auto const end = std::chrono::steady_clock::now();
+
+    TraceEvent event;
+    event.name = m_name;
+    event.start_us = get_time_us(m_start) - g_tracing_start_us.load();
+    event.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - m_start).count();
+    event.thread_id = get_thread_id();
+    event.args = m_args;
+    event.args_n = m_args_n;
+
+    auto& thread_trace_buffer = get_thread_trace_buffer();
+
+    std::lock_guard<std::mutex> lock(thread_trace_buffer.mutex);
+    thread_trace_buffer.events.push_back(event);
+}
+
+
+void TraceSpan::set_arg(char const* key, double const value)
+{
+    if (m_is_recording && m_args_n < ARGS_N_MAX)
+    {
+        m_args[m_args_n++] = std::make_pair(key, value);
+    }
+}
+
+}
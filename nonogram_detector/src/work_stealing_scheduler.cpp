@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <exception>
+
+#include "tracing.hpp"
+#include "work_stealing_scheduler.hpp"
+
+namespace ng
+{
+
+namespace
+{
+
+// Scheduler and worker of the calling thread, null (-1) outside of the workers
+thread_local WorkStealingScheduler const* t_scheduler = nullptr;
+thread_local int t_worker_index = -1;
+
+
+// Progress of one parallel_for, the queued helpers may outlive the call
+struct ParallelForState
+{
+    ParallelForState(int const n, std::function<void(int)> const& body)
+        : n(n)
+        , body(body)
+        , index_next(0)
+        , done_n(0)
+    {
+    }
+
+    int const n;
+    std::function<void(int)> const& body;
+    std::atomic<int> index_next;
+    std::atomic<int> done_n;
+
+    // Guards the exception, the last index done notifies the calling thread under it
+    std::mutex mutex;
+    std::condition_variable all_done;
+
+    // The first exception thrown by <body>, rethrown on the calling thread
+    std::exception_ptr exception;
+
+    // <body> is only touched while some index is not done, so it is still alive
+    void run()
+    {
+        for (auto index = index_next++; index < n; index = index_next++)
+        {
+            try
+            {
+                body(index);
+            }
+            catch (...)
+            {
+                set_exception(std::current_exception());
+            }
+
+            add_done(1);
+        }
+    }
+
+    void add_done(int const count)
+    {
+        if (done_n.fetch_add(count, std::memory_order_acq_rel) + count == n)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            all_done.notify_all();
+        }
+    }
+
+    // Keeps the first exception and marks the indices which were not taken yet as done
+    void set_exception(std::exception_ptr const& exception_thrown)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!exception)
+            {
+                exception = exception_thrown;
+            }
+        }
+
+        auto const index_skipped = index_next.exchange(n);
+        if (index_skipped < n)
+        {
+            add_done(n - index_skipped);
+        }
+    }
+};
+
+}
+
+
+WorkStealingScheduler::WorkStealingScheduler(int const workers_n)
+    : m_tasks_n(0)
+    , m_is_stopping(false)
+{
+    for (int i = 0; i < std::max(workers_n, 0) + 1; ++i)
+    {
+        m_task_queues.emplace_back(new TaskQueue());
+    }
+
+    for (int worker_index = 0; worker_index < std::max(workers_n, 0); ++worker_index)
+    {
+        m_workers.emplace_back(&WorkStealingScheduler::run, this, worker_index);
+    }
+}
+
+
+WorkStealingScheduler::~WorkStealingScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopping = true;
+    }
+
+    m_task_pushed.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    // Without workers the tasks run here
+    while (try_run_task(get_task_queue_index()))
+    {
+    }
+}
+
+
+void WorkStealingScheduler::submit(std::function<void()> task)
+{
+    push(get_task_queue_index(), std::move(task));
+}
+
+
+void WorkStealingScheduler::parallel_for(int const n, std::function<void(int)> const& body)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+
+    auto const state = std::make_shared<ParallelForState>(n, body);
+
+    auto const helpers_n = std::min(n, get_workers_n() + 1) - 1;
+    auto const task_queue_index = get_task_queue_index();
+    for (int i = 0; i < helpers_n; ++i)
+    {
+        push(task_queue_index, [state]() { state->run(); });
+    }
+
+    state->run();
+
+    // The indices taken by the helpers may still run, the queued tasks are run meanwhile.
+    // Once the queues are empty the thread blocks instead of competing with the helpers for the cores.
+    // The helpers run their indices to the end, so no index waits for a task this thread would run
+    while (state->done_n.load(std::memory_order_acquire) < n)
+    {
+        if (try_run_task(task_queue_index))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->all_done.wait(lock, [&state, n]() { return state->done_n.load(std::memory_order_acquire) >= n; });
+    }
+
+    // No helper touches <body> any more
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->exception)
+    {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+
+int WorkStealingScheduler::get_workers_n() const
+{
+    return static_cast<int>(m_workers.size());
+}
+
+
+void WorkStealingScheduler::run(int const worker_index)
+{
+    t_scheduler = this;
+    t_worker_index = worker_index;
+
+    while (true)
+    {
+        if (try_run_task(worker_index))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_task_pushed.wait(lock, [this]() { return m_is_stopping || m_tasks_n.load() > 0; });
+
+        if (m_is_stopping && m_tasks_n.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+
+int WorkStealingScheduler::get_task_queue_index() const
+{
+    return t_scheduler == this ? t_worker_index : static_cast<int>(m_task_queues.size()) - 1;
+}
+
+
+void WorkStealingScheduler::push(int const task_queue_index, std::function<void()> task)
+{
+    {
+        auto& task_queue = *m_task_queues[task_queue_index];
+
+        std::lock_guard<std::mutex> lock(task_queue.mutex);
+        task_queue.tasks.push_back(std::move(task));
+    }
+
+    // Counted under the lock, so a worker about to wait does not miss the task
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_tasks_n;
+    }
+
+    m_task_pushed.notify_one();
+}
+
+
+bool WorkStealingScheduler::try_run_task(int const task_queue_index)
+{
+    auto const task_queues_n = static_cast<int>(m_task_queues.size());
+
+    std::function<void()> task;
+
+    // The own deque first, newest first, as its data is likely still in the cache
+    {
+        auto& task_queue = *m_task_queues[task_queue_index];
+
+        std::lock_guard<std::mutex> lock(task_queue.mutex);
+        if (!task_queue.tasks.empty())
+        {
+            task = std::move(task_queue.tasks.back());
+            task_queue.tasks.pop_back();
+        }
+    }
+
+    for (int i = 1; !task && i < task_queues_n; ++i)
+    {
+        auto& task_queue = *m_task_queues[(task_queue_index + i) % task_queues_n];
+
+        std::lock_guard<std::mutex> lock(task_queue.mutex);
+        if (!task_queue.tasks.empty())
+        {
+            task = std::move(task_queue.tasks.front());
+            task_queue.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+    {
+        return false;
+    }
+
+    --m_tasks_n;
+
+    // The gaps between the tasks of a worker show its idle time
+    NG_TRACE_SPAN(trace_span, "scheduler_task");
+    task();
+
+    return true;
+}
+
+}
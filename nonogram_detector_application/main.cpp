@@ -1,18 +1,28 @@
+#include <algorithm>
 #include <chrono>
-#include <iomanip>
+#include <csignal>
+#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <string>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "allocation_tracking.hpp"
+#include "batch_pipeline.hpp"
+#include "cell_archive.hpp"
 #include "cross_locs_detector.hpp"
+#include "detection_server.hpp"
+#include "execution_policy.hpp"
+#include "grid_serialization.hpp"
+#include "image_loader.hpp"
 #include "image_operations.hpp"
+#include "overlay_renderer.hpp"
+#include "tracing.hpp"
 
 // Returns cv::Mat(cross_locs.size() - cv::Size(1, 1), CV_32SC4)
 cv::Mat get_cell_rois(cv::Mat const& cross_locs)
 {
-    std::cout << cross_locs.size() << std::endl;
-
     auto const cell_rois_size = cross_locs.size() - cv::Size(1, 1);
     cv::Mat cell_rois(cell_rois_size, CV_32SC4);
 
@@ -72,34 +82,221 @@ std::vector<std::vector<cv::Mat>> get_cell_images(cv::Mat const& image, cv::Mat
 }
 
 
-void save_images(std::string const& images_dir_path, std::vector<std::vector<cv::Mat>> const& cell_images)
+// Parameters of the batch and the server modes
+ng::ThresholdProfile get_default_threshold_profile()
+{
+    ng::ThresholdProfile threshold_profile;
+    threshold_profile.resize_width_height_max = 1200;
+    threshold_profile.threshold_block_size = 15;
+    threshold_profile.threshold_c = 10.0;
+
+    return threshold_profile;
+}
+
+
+// Detects the grids on every image listed in <list_path>, one path per line,
+// and writes a grid record per image to <output_path>, JSON if it ends with .json
+int run_batch(std::string const& list_path, std::string const& output_path)
 {
-    for (auto i = 0; i < cell_images.size(); ++i)
+    std::ifstream list_file(list_path);
+    if (!list_file)
+    {
+        std::cout << "List was not read" << std::endl;
+
+        return 1;
+    }
+
+    std::vector<std::string> input_paths;
+    std::string input_path;
+    while (std::getline(list_file, input_path))
+    {
+        if (!input_path.empty())
+        {
+            input_paths.push_back(input_path);
+        }
+    }
+
+    std::string const json_extension = ".json";
+    auto const output_format =
+        output_path.size() >= json_extension.size() &&
+        output_path.compare(output_path.size() - json_extension.size(), json_extension.size(), json_extension) == 0 ?
+        ng::GridRecordFormat::JSON :
+        ng::GridRecordFormat::BINARY;
+
+    ng::GridRecordWriter grid_record_writer;
+    if (!grid_record_writer.open(output_path, output_format))
     {
-        for (auto j = 0; j < cell_images.front().size(); ++j)
+        std::cout << "Output was not opened" << std::endl;
+
+        return 1;
+    }
+
+    auto const threshold_profile = get_default_threshold_profile();
+
+    // The cores go to the images first, a short list leaves some to every detection
+    auto const execution_policy = ng::get_execution_policy(static_cast<int>(input_paths.size()));
+    ng::apply_execution_policy(execution_policy);
+
+    ng::DetectionOptions detection_options;
+    detection_options.scheduler = ng::make_scheduler(execution_policy);
+
+    ng::CrossLocsDetector cross_loc_detector(threshold_profile, 5, 50, 0.9, detection_options);
+
+    ng::BatchOptions batch_options;
+    batch_options.detect_workers_n = execution_policy.image_workers_n;
+    batch_options.decode_width_height_min = threshold_profile.resize_width_height_max;
+
+    ng::BatchPipeline batch_pipeline(cross_loc_detector, batch_options);
+
+    auto const start = std::chrono::steady_clock::now();
+
+    auto const written_n = batch_pipeline.run(
+        input_paths,
+        [&grid_record_writer, &threshold_profile](ng::BatchRecord const& batch_record)
         {
-            std::ostringstream image_path_stream;
+            // The images which were not decoded are written as not found
+            ng::GridRecord grid_record;
+            grid_record.source = batch_record.input_path;
+            grid_record.threshold_profile = threshold_profile;
+            grid_record.detection_result = batch_record.detection_result;
+
+            grid_record_writer.write(grid_record);
+        });
+
+    grid_record_writer.close();
 
-            image_path_stream << images_dir_path << R"(\)";
+    auto const end = std::chrono::steady_clock::now();
+
+    std::cout << "Images: " << written_n << std::endl;
+    std::cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+
+    return 0;
+}
+
+
+// Serves the detection requests on the Unix domain socket at <socket_path>,
+// or on stdin and stdout if <socket_path> is "-", until the process is killed (the input ends)
+int run_server(std::string const& socket_path)
+{
+#ifndef _WIN32
+    // A client which disconnects before its response is written must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    auto const threshold_profile = get_default_threshold_profile();
+
+    ng::CrossLocsDetector cross_loc_detector(threshold_profile, 5, 50, 0.9);
+
+    ng::DetectionServerOptions server_options;
+    server_options.decode_width_height_min = threshold_profile.resize_width_height_max;
+
+    // Every worker detects an image on its own, OpenCV does not start more threads
+    ng::apply_execution_policy(ng::get_execution_policy(server_options.workers_n));
+
+    ng::DetectionServer detection_server(cross_loc_detector, threshold_profile, server_options);
+
+    auto const served = socket_path == "-" ?
+        detection_server.serve_stream(0, 1) :
+        detection_server.serve(socket_path);
+
+    if (!served)
+    {
+        std::cerr << "Server was not started" << std::endl;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Sends the images at <image_paths> to the server at <socket_path> one by one
+// and prints a line per image with the response time
+int run_client(std::string const& socket_path, std::vector<std::string> const& image_paths)
+{
+    ng::DetectionClient detection_client;
+    if (!detection_client.connect(socket_path))
+    {
+        std::cout << "Server was not connected" << std::endl;
+
+        return 1;
+    }
+
+    for (auto const& image_path : image_paths)
+    {
+        auto const start = std::chrono::steady_clock::now();
 
-            image_path_stream << std::setw(3) << std::setfill('0');
-            image_path_stream << i;
-            image_path_stream << "_";
-            image_path_stream << std::setw(3) << std::setfill('0');
-            image_path_stream << j << ".png";
+        bool response_received;
+        ng::DetectionResponseStatus status;
+        ng::GridRecord grid_record;
+        std::tie(response_received, status, grid_record) = detection_client.detect_path(image_path);
 
-            auto const image_path = image_path_stream.str();
+        auto const end = std::chrono::steady_clock::now();
 
-            auto const image = cell_images[i][j];
+        if (!response_received)
+        {
+            std::cout << "Response was not received" << std::endl;
 
-            cv::imwrite(image_path, image);
+            return 1;
         }
+
+        auto const& detection_result = grid_record.detection_result;
+
+        std::cout
+            << image_path << "\t"
+            << static_cast<int>(status) << "\t"
+            << (detection_result.is_found ? 1 : 0) << "\t"
+            << detection_result.cross_locs_main_mat.rows << "\t"
+            << detection_result.cross_locs_main_mat.cols << "\t"
+            << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us" << std::endl;
     }
+
+    return 0;
 }
 
 
-int main()
+int run(std::vector<std::string> const& arguments)
 {
+
+    if (!arguments.empty() && arguments.front() == "--serve")
+    {
+        if (arguments.size() != 2)
+        {
+            std::cout << "Usage: nonogram_detector_application --serve socket_path|-" << std::endl;
+
+            return 1;
+        }
+
+        return run_server(arguments[1]);
+    }
+
+    if (!arguments.empty() && arguments.front() == "--request")
+    {
+        if (arguments.size() < 3)
+        {
+            std::cout << "Usage: nonogram_detector_application --request socket_path image_path..." << std::endl;
+
+            return 1;
+        }
+
+        return run_client(arguments[1], std::vector<std::string>(arguments.begin() + 2, arguments.end()));
+    }
+
+    if (!arguments.empty() && arguments.front() == "--batch")
+    {
+        if (arguments.size() != 3)
+        {
+            std::cout << "Usage: nonogram_detector_application --batch list_path output_path" << std::endl;
+
+            return 1;
+        }
+
+        return run_batch(arguments[1], arguments[2]);
+    }
+
+    // Without a path the cells are extracted but not written
+    std::string const cell_archive_path = !arguments.empty() ? arguments.front() : std::string();
+
     //std::string const image_path =
     //    R"(C:\Users\klimenkov\Desktop\nonograms\20191102_004052.jpg)";
     std::string const name = "nonogram";
@@ -108,7 +305,26 @@ int main()
     //std::string const image_path =
     //    R"(C:\Users\klimenkov\Desktop\nonograms\vqtsmfq7o3k21.jpg)";
 
-    auto image = cv::imread(image_path);
+    // The parameters are tuned per source with nonogram_detector_test --tune
+    std::string const profiles_path = "threshold_profiles.yml";
+    std::string const profile_name = "default";
+
+    bool threshold_profile_found;
+    ng::ThresholdProfile threshold_profile;
+    std::tie(threshold_profile_found, threshold_profile) = ng::load_threshold_profile(profiles_path, profile_name);
+
+    if (!threshold_profile_found)
+    {
+        threshold_profile.resize_width_height_max = 1200;
+        threshold_profile.threshold_block_size = 15;
+        threshold_profile.threshold_c = 10.0;
+    }
+
+    // JPEG photos are decoded straight to gray at a reduced scale which still fits the resize width (height) max.
+    // The grids stay in the coordinates of the decoded image, the cells are cut from it
+    cv::Mat image;
+    float input_scale;
+    std::tie(image, input_scale) = ng::load_image_reduced(image_path, threshold_profile.resize_width_height_max);
 
     if (image.empty())
     {
@@ -117,19 +333,15 @@ int main()
         return 1;
     }
 
+    std::cout << "input_scale: " << input_scale << std::endl;
+
     //cv::imshow("image", image);
     //cv::waitKey();
 
-    // for Yan nonogram
-    //ng::CrossLocsDetector cross_loc_detector(2200, 15, 4.0, 5, 50, 0.9);
-
-    ng::CrossLocsDetector cross_loc_detector(1200, 15, 10.0, 5, 50, 0.9);
-
-    cv::Mat image_gray;
-    cv::cvtColor(image, image_gray, cv::COLOR_BGR2GRAY);
+    ng::CrossLocsDetector cross_loc_detector(threshold_profile, 5, 50, 0.9);
 
     auto const image_thresholded =
-        ng::threshold(image_gray, 15, 10.0);
+        ng::threshold(image, threshold_profile.threshold_block_size, threshold_profile.threshold_c);
 
     bool cell_loc_found;
     cv::Mat cross_locs_main;
@@ -138,15 +350,13 @@ int main()
     std::tie(cell_loc_found, cross_locs_main, cross_locs_top, cross_locs_left) =
         cross_loc_detector.detect(image);
 
-    int const radius = 8;
-    auto image_draw = ng::CrossLocsDetector::draw(image, cross_locs_main, radius, cv::Scalar(255, 0, 0));
-    image_draw = ng::CrossLocsDetector::draw(image_draw, cross_locs_top, radius, cv::Scalar(0, 255, 0));
-    image_draw = ng::CrossLocsDetector::draw(image_draw, cross_locs_left, radius, cv::Scalar(0, 0, 255));
+    // The overlay is drawn on the display sized image
+    ng::OverlayRenderer overlay_renderer(1000);
+    auto const& image_draw = overlay_renderer.render(image, cross_locs_main, cross_locs_top, cross_locs_left);
 
     //cv::Mat image_thresholded_visible = image_thresholded * 255;
 
     //cv::resize(image_thresholded_visible, image_thresholded_visible, {}, 0.25, 0.25);
-    cv::resize(image_draw, image_draw, {}, 0.25, 0.25);
 
     ////cv::imwrite("grid.png", image_draw);
     cv::imshow("image_draw", image_draw);
@@ -155,11 +365,66 @@ int main()
 
     //auto const cell_rois = get_cell_rois(cross_locs_left);
     //auto const cell_images = get_cell_images(image, cell_rois);
-    auto const cell_images = ng::get_cell_warped_images_vector(image_thresholded, cross_locs_left);
 
-    //std::string const images_dir_path =
-    //    R"(C:\Users\klimenkov\Desktop\nonograms_digits\)" + name + R"(\left)";
-    //save_images(images_dir_path, cell_images);
+    // All the cells of the puzzle go into one file
+    ng::CellArchiveWriter cell_archive_writer;
+    {
+        ng::AllocationScope allocation_scope;
+
+        cell_archive_writer.add(ng::CellArea::MAIN, ng::get_cell_warped_images_vector(image_thresholded, cross_locs_main));
+        cell_archive_writer.add(ng::CellArea::TOP, ng::get_cell_warped_images_vector(image_thresholded, cross_locs_top));
+        cell_archive_writer.add(ng::CellArea::LEFT, ng::get_cell_warped_images_vector(image_thresholded, cross_locs_left));
+
+        auto const allocation_stats = allocation_scope.get_stats();
+        std::cout
+            << "cells allocations: " << allocation_stats.allocations_n
+            << ", bytes: " << allocation_stats.allocated_bytes_n
+            << ", peak live bytes: " << allocation_stats.peak_live_bytes_n << std::endl;
+    }
+
+    if (!cell_archive_path.empty() && !cell_archive_writer.write(cell_archive_path))
+    {
+        std::cout << "Cell archive was not written: " << cell_archive_path << std::endl;
+
+        return 1;
+    }
 
     return 0;
 }
+
+
+// Usage:
+//   nonogram_detector_application [--trace trace_path] ...
+//   nonogram_detector_application [cell_archive_path]
+//   nonogram_detector_application --batch list_path output_path
+//   nonogram_detector_application --serve socket_path|-
+//   nonogram_detector_application --request socket_path image_path...
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> const arguments(argv + 1, argv + argc);
+
+    ng::install_allocation_tracking();
+
+    // Records the spans of the whole run as a Chrome trace
+    if (arguments.size() >= 2 && arguments.front() == "--trace")
+    {
+#ifndef NG_ENABLE_TRACING
+        std::cerr << "Built without NG_ENABLE_TRACING, the trace is empty" << std::endl;
+#endif
+
+        ng::start_tracing();
+        auto const result = run(std::vector<std::string>(arguments.begin() + 2, arguments.end()));
+        ng::stop_tracing();
+
+        if (!ng::write_chrome_trace(arguments[1]))
+        {
+            std::cerr << "Trace was not written" << std::endl;
+
+            return 1;
+        }
+
+        return result;
+    }
+
+    return run(arguments);
+}
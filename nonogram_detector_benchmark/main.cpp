@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "allocation_tracking.hpp"
+#include "async_cross_locs_detector.hpp"
+#include "cross_locs_detector.hpp"
+#include "image_operations.hpp"
+#include "synthetic_puzzle.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+struct BenchmarkReport
+{
+    double latency_p50_ms = 0.0;
+    double latency_p90_ms = 0.0;
+    double latency_p99_ms = 0.0;
+    double throughput = 0.0;
+    double peak_rss_mb = 0.0;
+
+    // Ratio of the samples with the main grid of the right size and some of its crosses found
+    double detection_ratio = 0.0;
+
+    // Distance between the detected and the true crosses of the detected main grids, in pixels
+    double localization_error_mean = 0.0;
+    double localization_error_max = 0.0;
+
+    // Heap allocations per image, 0 without NG_ENABLE_ALLOCATION_TRACKING
+    double detect_allocations_n_mean = 0.0;
+    double detect_peak_live_mb_max = 0.0;
+    double cells_peak_live_mb_max = 0.0;
+
+    // Worst case: a 200 x 200 grid on a 48 MP image
+    double footprint_detect_peak_live_mb = 0.0;
+    double footprint_cells_peak_live_mb = 0.0;
+};
+
+
+// Mean and max distance between the found crosses and the true ones,
+// the boolean flag shows if the grids have the same size and some cross was found
+std::tuple<bool, double, double> get_localization_error(
+    cv::Mat const& cross_locs_mat,
+    cv::Mat const& cross_locs_true_mat)
+{
+    if (cross_locs_mat.size() != cross_locs_true_mat.size())
+    {
+        return std::make_tuple(false, 0.0, 0.0);
+    }
+
+    auto error_sum = 0.0;
+    auto error_max = 0.0;
+    auto found_n = 0;
+    for (int row = 0; row < cross_locs_mat.rows; ++row)
+    {
+        for (int col = 0; col < cross_locs_mat.cols; ++col)
+        {
+            auto const& cross_loc = cross_locs_mat.at<cv::Point>(row, col);
+            if (cross_loc == cv::Point(-1, -1))
+            {
+                continue;
+            }
+
+            auto const delta = cv::Point2f(cross_loc) - cross_locs_true_mat.at<cv::Point2f>(row, col);
+            auto const error = std::sqrt(delta.dot(delta));
+
+            error_sum += error;
+            error_max = std::max(error_max, static_cast<double>(error));
+            ++found_n;
+        }
+    }
+
+    // A grid of the right size without any cross is not detected
+    if (found_n == 0)
+    {
+        return std::make_tuple(false, 0.0, 0.0);
+    }
+
+    return std::make_tuple(true, error_sum / found_n, error_max);
+}
+
+
+double get_peak_rss_mb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS process_memory_counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &process_memory_counters, sizeof(process_memory_counters));
+
+    return process_memory_counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    rusage resource_usage;
+    getrusage(RUSAGE_SELF, &resource_usage);
+
+    // Kilobytes on Linux
+    return resource_usage.ru_maxrss / 1024.0;
+#endif
+}
+
+
+double get_mb(int64_t const bytes_n)
+{
+    return bytes_n / (1024.0 * 1024.0);
+}
+
+
+// Peak live bytes of the cell extraction of the main grid
+double get_cells_peak_live_mb(cv::Mat const& image, cv::Mat const& cross_locs_main_mat)
+{
+    auto const image_thresholded = ng::threshold(image, 15, 10.0);
+
+    ng::AllocationScope allocation_scope;
+    ng::get_cell_warped_images_vector(image_thresholded, cross_locs_main_mat);
+
+    return get_mb(allocation_scope.get_stats().peak_live_bytes_n);
+}
+
+
+double get_percentile(std::vector<double> values, double const percentile)
+{
+    std::sort(values.begin(), values.end());
+
+    return values[static_cast<size_t>(percentile * (values.size() - 1))];
+}
+
+
+BenchmarkReport run_benchmark(ng::CrossLocsDetector const& cross_locs_detector, std::vector<ng::SyntheticPuzzle> const& samples)
+{
+    BenchmarkReport benchmark_report;
+
+    // Latency and accuracy one image at a time
+    cross_locs_detector.detect(samples.front().image, ng::Deadline());
+
+    std::vector<double> latencies_ms;
+    auto detected_n = 0;
+    auto error_sum = 0.0;
+    int64_t allocations_n_sum = 0;
+    for (auto const& sample : samples)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        auto const detection_result = cross_locs_detector.detect(sample.image, ng::Deadline());
+        auto const end = std::chrono::steady_clock::now();
+
+        latencies_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+        allocations_n_sum += detection_result.allocations.allocations_n;
+        benchmark_report.detect_peak_live_mb_max = std::max(
+            benchmark_report.detect_peak_live_mb_max,
+            get_mb(detection_result.allocations.peak_live_bytes_n));
+        benchmark_report.cells_peak_live_mb_max = std::max(
+            benchmark_report.cells_peak_live_mb_max,
+            get_cells_peak_live_mb(sample.image, detection_result.cross_locs_main_mat));
+
+        bool is_detected;
+        double error_mean;
+        double error_max;
+        std::tie(is_detected, error_mean, error_max) = get_localization_error(
+            detection_result.cross_locs_main_mat,
+            sample.cross_locs_main_mat);
+
+        if (is_detected)
+        {
+            ++detected_n;
+            error_sum += error_mean;
+            benchmark_report.localization_error_max = std::max(benchmark_report.localization_error_max, error_max);
+        }
+    }
+
+    benchmark_report.latency_p50_ms = get_percentile(latencies_ms, 0.5);
+    benchmark_report.latency_p90_ms = get_percentile(latencies_ms, 0.9);
+    benchmark_report.latency_p99_ms = get_percentile(latencies_ms, 0.99);
+    benchmark_report.detection_ratio = static_cast<double>(detected_n) / samples.size();
+    benchmark_report.localization_error_mean = detected_n > 0 ? error_sum / detected_n : 0.0;
+    benchmark_report.detect_allocations_n_mean = static_cast<double>(allocations_n_sum) / samples.size();
+
+    // Throughput with all the cores busy
+    auto const workers_n = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    ng::AsyncCrossLocsDetector async_cross_locs_detector(cross_locs_detector, workers_n, 2 * workers_n);
+
+    std::vector<std::shared_ptr<cv::Mat const>> images;
+    for (auto const& sample : samples)
+    {
+        images.push_back(std::make_shared<cv::Mat const>(sample.image));
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<std::future<ng::DetectionResult>> detection_result_futures;
+    for (auto const& image : images)
+    {
+        detection_result_futures.push_back(async_cross_locs_detector.submit(image));
+    }
+
+    for (auto& detection_result_future : detection_result_futures)
+    {
+        detection_result_future.get();
+    }
+
+    auto const end = std::chrono::steady_clock::now();
+
+    benchmark_report.throughput = samples.size() / std::chrono::duration<double>(end - start).count();
+    benchmark_report.peak_rss_mb = get_peak_rss_mb();
+
+    // Last, so the large image does not count in the peak RSS of the corpus
+    cv::RNG rng(20191102);
+    auto const sample_large = ng::generate_synthetic_puzzle(rng, 200, 200, 33);
+
+    auto const detection_result = cross_locs_detector.detect(sample_large.image, ng::Deadline());
+    benchmark_report.footprint_detect_peak_live_mb = get_mb(detection_result.allocations.peak_live_bytes_n);
+    benchmark_report.footprint_cells_peak_live_mb =
+        get_cells_peak_live_mb(sample_large.image, detection_result.cross_locs_main_mat);
+
+    return benchmark_report;
+}
+
+
+void print(BenchmarkReport const& benchmark_report)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Latency p50: " << benchmark_report.latency_p50_ms << " ms" << std::endl;
+    std::cout << "Latency p90: " << benchmark_report.latency_p90_ms << " ms" << std::endl;
+    std::cout << "Latency p99: " << benchmark_report.latency_p99_ms << " ms" << std::endl;
+    std::cout << "Throughput: " << benchmark_report.throughput << " images/s" << std::endl;
+    std::cout << "Peak RSS: " << benchmark_report.peak_rss_mb << " MB" << std::endl;
+    std::cout << "Detection ratio: " << benchmark_report.detection_ratio << std::endl;
+    std::cout << "Localization error mean: " << benchmark_report.localization_error_mean << " px" << std::endl;
+    std::cout << "Localization error max: " << benchmark_report.localization_error_max << " px" << std::endl;
+
+    if (!ng::is_allocation_tracking_enabled())
+    {
+        std::cout << "Built without NG_ENABLE_ALLOCATION_TRACKING, the allocations are not counted" << std::endl;
+
+        return;
+    }
+
+    std::cout << "Detect allocations mean: " << benchmark_report.detect_allocations_n_mean << std::endl;
+    std::cout << "Detect peak live max: " << benchmark_report.detect_peak_live_mb_max << " MB" << std::endl;
+    std::cout << "Cells peak live max: " << benchmark_report.cells_peak_live_mb_max << " MB" << std::endl;
+    std::cout << "200 x 200 grid, 48 MP, detect peak live: " << benchmark_report.footprint_detect_peak_live_mb << " MB" << std::endl;
+    std::cout << "200 x 200 grid, 48 MP, cells peak live: " << benchmark_report.footprint_cells_peak_live_mb << " MB" << std::endl;
+}
+
+
+bool save_baseline(std::string const& file_path, BenchmarkReport const& benchmark_report)
+{
+    cv::FileStorage file_storage(file_path, cv::FileStorage::WRITE);
+    if (!file_storage.isOpened())
+    {
+        return false;
+    }
+
+    file_storage << "is_recorded" << 1;
+    file_storage << "latency_p50_ms" << benchmark_report.latency_p50_ms;
+    file_storage << "latency_p90_ms" << benchmark_report.latency_p90_ms;
+    file_storage << "latency_p99_ms" << benchmark_report.latency_p99_ms;
+    file_storage << "throughput" << benchmark_report.throughput;
+    file_storage << "peak_rss_mb" << benchmark_report.peak_rss_mb;
+    file_storage << "detection_ratio" << benchmark_report.detection_ratio;
+    file_storage << "localization_error_mean" << benchmark_report.localization_error_mean;
+    file_storage << "localization_error_max" << benchmark_report.localization_error_max;
+    file_storage << "detect_allocations_n_mean" << benchmark_report.detect_allocations_n_mean;
+    file_storage << "detect_peak_live_mb_max" << benchmark_report.detect_peak_live_mb_max;
+    file_storage << "cells_peak_live_mb_max" << benchmark_report.cells_peak_live_mb_max;
+    file_storage << "footprint_detect_peak_live_mb" << benchmark_report.footprint_detect_peak_live_mb;
+    file_storage << "footprint_cells_peak_live_mb" << benchmark_report.footprint_cells_peak_live_mb;
+
+    return true;
+}
+
+
+// The boolean flags show if the file was read and if it holds a recorded run,
+// the baseline in the repository is a placeholder until it is recorded on the reference machine
+std::tuple<bool, bool, BenchmarkReport> load_baseline(std::string const& file_path)
+{
+    BenchmarkReport benchmark_report;
+
+    cv::FileStorage file_storage(file_path, cv::FileStorage::READ);
+    if (!file_storage.isOpened())
+    {
+        return std::make_tuple(false, false, benchmark_report);
+    }
+
+    if (static_cast<int>(file_storage["is_recorded"]) == 0)
+    {
+        return std::make_tuple(true, false, benchmark_report);
+    }
+
+    benchmark_report.latency_p50_ms = static_cast<double>(file_storage["latency_p50_ms"]);
+    benchmark_report.latency_p90_ms = static_cast<double>(file_storage["latency_p90_ms"]);
+    benchmark_report.latency_p99_ms = static_cast<double>(file_storage["latency_p99_ms"]);
+    benchmark_report.throughput = static_cast<double>(file_storage["throughput"]);
+    benchmark_report.peak_rss_mb = static_cast<double>(file_storage["peak_rss_mb"]);
+    benchmark_report.detection_ratio = static_cast<double>(file_storage["detection_ratio"]);
+    benchmark_report.localization_error_mean = static_cast<double>(file_storage["localization_error_mean"]);
+    benchmark_report.localization_error_max = static_cast<double>(file_storage["localization_error_max"]);
+    benchmark_report.detect_allocations_n_mean = static_cast<double>(file_storage["detect_allocations_n_mean"]);
+    benchmark_report.detect_peak_live_mb_max = static_cast<double>(file_storage["detect_peak_live_mb_max"]);
+    benchmark_report.cells_peak_live_mb_max = static_cast<double>(file_storage["cells_peak_live_mb_max"]);
+    benchmark_report.footprint_detect_peak_live_mb = static_cast<double>(file_storage["footprint_detect_peak_live_mb"]);
+    benchmark_report.footprint_cells_peak_live_mb = static_cast<double>(file_storage["footprint_cells_peak_live_mb"]);
+
+    return std::make_tuple(true, true, benchmark_report);
+}
+
+
+// The accuracy on the synthetic corpus does not depend on the machine, so it has fixed limits
+// which hold with or without a recorded baseline
+bool check_accuracy(BenchmarkReport const& benchmark_report)
+{
+    auto const DETECTION_RATIO_MIN = 0.75;
+    auto const LOCALIZATION_ERROR_MEAN_MAX = 2.0;
+
+    // Half of the smallest cell of the corpus, a larger error is a wrong cross
+    auto const LOCALIZATION_ERROR_MAX_MAX = 9.0;
+
+    auto is_passed = true;
+    auto const check = [&is_passed](bool const is_failed, std::string const& name, double const value, double const limit)
+    {
+        if (is_failed)
+        {
+            std::cout << "Accuracy: " << name << " " << value << " (limit " << limit << ")" << std::endl;
+            is_passed = false;
+        }
+    };
+
+    check(
+        benchmark_report.detection_ratio < DETECTION_RATIO_MIN,
+        "detection ratio",
+        benchmark_report.detection_ratio,
+        DETECTION_RATIO_MIN);
+    check(
+        benchmark_report.localization_error_mean > LOCALIZATION_ERROR_MEAN_MAX,
+        "localization error mean",
+        benchmark_report.localization_error_mean,
+        LOCALIZATION_ERROR_MEAN_MAX);
+    check(
+        benchmark_report.localization_error_max > LOCALIZATION_ERROR_MAX_MAX,
+        "localization error max",
+        benchmark_report.localization_error_max,
+        LOCALIZATION_ERROR_MAX_MAX);
+
+    return is_passed;
+}
+
+
+// Prints every metric which is worse than the baseline beyond its tolerance and returns false if there are any
+bool check_regressions(BenchmarkReport const& benchmark_report, BenchmarkReport const& baseline)
+{
+    auto const LATENCY_RATIO_MAX = 1.2;
+    auto const THROUGHPUT_RATIO_MIN = 0.8;
+    auto const PEAK_RSS_RATIO_MAX = 1.2;
+    auto const DETECTION_RATIO_DELTA_MAX = 0.0;
+    auto const LOCALIZATION_ERROR_DELTA_MAX = 0.5;
+    auto const ALLOCATIONS_RATIO_MAX = 1.2;
+
+    auto is_passed = true;
+    auto const check = [&is_passed](bool const is_regressed, std::string const& name, double const value, double const value_baseline)
+    {
+        if (is_regressed)
+        {
+            std::cout << "Regression: " << name << " " << value << " (baseline " << value_baseline << ")" << std::endl;
+            is_passed = false;
+        }
+    };
+
+    check(
+        benchmark_report.latency_p50_ms > LATENCY_RATIO_MAX * baseline.latency_p50_ms,
+        "latency p50",
+        benchmark_report.latency_p50_ms,
+        baseline.latency_p50_ms);
+    check(
+        benchmark_report.latency_p90_ms > LATENCY_RATIO_MAX * baseline.latency_p90_ms,
+        "latency p90",
+        benchmark_report.latency_p90_ms,
+        baseline.latency_p90_ms);
+    check(
+        benchmark_report.throughput < THROUGHPUT_RATIO_MIN * baseline.throughput,
+        "throughput",
+        benchmark_report.throughput,
+        baseline.throughput);
+    check(
+        benchmark_report.peak_rss_mb > PEAK_RSS_RATIO_MAX * baseline.peak_rss_mb,
+        "peak RSS",
+        benchmark_report.peak_rss_mb,
+        baseline.peak_rss_mb);
+    check(
+        benchmark_report.detection_ratio < baseline.detection_ratio - DETECTION_RATIO_DELTA_MAX,
+        "detection ratio",
+        benchmark_report.detection_ratio,
+        baseline.detection_ratio);
+    check(
+        benchmark_report.localization_error_mean > baseline.localization_error_mean + LOCALIZATION_ERROR_DELTA_MAX,
+        "localization error mean",
+        benchmark_report.localization_error_mean,
+        baseline.localization_error_mean);
+
+    // A baseline without the allocations counted (0) is not compared
+    auto const check_allocations = [&check, ALLOCATIONS_RATIO_MAX](std::string const& name, double const value, double const value_baseline)
+    {
+        check(value_baseline > 0.0 && value > ALLOCATIONS_RATIO_MAX * value_baseline, name, value, value_baseline);
+    };
+
+    check_allocations(
+        "detect allocations mean",
+        benchmark_report.detect_allocations_n_mean,
+        baseline.detect_allocations_n_mean);
+    check_allocations(
+        "detect peak live max",
+        benchmark_report.detect_peak_live_mb_max,
+        baseline.detect_peak_live_mb_max);
+    check_allocations(
+        "cells peak live max",
+        benchmark_report.cells_peak_live_mb_max,
+        baseline.cells_peak_live_mb_max);
+    check_allocations(
+        "footprint detect peak live",
+        benchmark_report.footprint_detect_peak_live_mb,
+        baseline.footprint_detect_peak_live_mb);
+    check_allocations(
+        "footprint cells peak live",
+        benchmark_report.footprint_cells_peak_live_mb,
+        baseline.footprint_cells_peak_live_mb);
+
+    return is_passed;
+}
+
+
+// Usage:
+//   nonogram_detector_benchmark [baseline_path [--update]]
+// Checks the accuracy limits and compares the run with the baseline, fails on either.
+// --update saves the run as the new baseline.
+// CTest runs it against baseline.yml next to this file
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> const arguments(argv + 1, argv + argc);
+
+    ng::install_allocation_tracking();
+
+    auto const SAMPLES_N = 32;
+
+    auto const samples = ng::generate_synthetic_puzzles(SAMPLES_N);
+
+    ng::CrossLocsDetector const cross_locs_detector(1200, 15, 10.0, 5, 50, 0.9);
+
+    auto const benchmark_report = run_benchmark(cross_locs_detector, samples);
+    print(benchmark_report);
+
+    if (arguments.empty())
+    {
+        return 0;
+    }
+
+    auto const& baseline_path = arguments[0];
+
+    if (arguments.size() > 1 && arguments[1] == "--update")
+    {
+        if (!save_baseline(baseline_path, benchmark_report))
+        {
+            std::cout << "Baseline was not saved: " << baseline_path << std::endl;
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    bool baseline_loaded;
+    bool baseline_recorded;
+    BenchmarkReport baseline;
+    std::tie(baseline_loaded, baseline_recorded, baseline) = load_baseline(baseline_path);
+
+    if (!baseline_loaded)
+    {
+        std::cout << "Baseline was not read: " << baseline_path << std::endl;
+
+        return 1;
+    }
+
+    auto const is_accurate = check_accuracy(benchmark_report);
+
+    // Only the accuracy limits are checked until the baseline is recorded
+    if (!baseline_recorded)
+    {
+        std::cout << "Baseline is not recorded, run with --update to record it: " << baseline_path << std::endl;
+
+        return is_accurate ? 0 : 1;
+    }
+
+    auto const is_not_regressed = check_regressions(benchmark_report, baseline);
+
+    return is_accurate && is_not_regressed ? 0 : 1;
+}
@@ -1,11 +1,136 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "cell_archive.hpp"
 #include "cross_locs_detector.hpp"
+#include "detection_server.hpp"
+#include "grid_serialization.hpp"
+#include "image_operations.hpp"
+#include "overlay_renderer.hpp"
+#include "synthetic_puzzle.hpp"
+#include "threshold_tuner.hpp"
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
+
+// Keeps the values of the recently used keys while their total size is within <size_max>
+template <typename Key, typename Value>
+class LruCache
+{
+public:
+    LruCache(
+        size_t const size_max,
+        std::function<size_t(Value const&)> const& get_size)
+        : M_SIZE_MAX(size_max)
+        , m_get_size(get_size)
+        , m_size(0)
+    {
+    }
+
+    // The boolean flag shows if the key was cached
+    std::pair<bool, Value> find(Key const& key)
+    {
+        auto const entry_it = m_entries_map.find(key);
+        if (entry_it == m_entries_map.end())
+        {
+            return std::make_pair(false, Value());
+        }
+
+        m_entries.splice(m_entries.begin(), m_entries, entry_it->second);
+
+        return std::make_pair(true, std::get<1>(*entry_it->second));
+    }
+
+    void put(Key const& key, Value const& value)
+    {
+        auto const entry_it = m_entries_map.find(key);
+        if (entry_it != m_entries_map.end())
+        {
+            m_size -= std::get<2>(*entry_it->second);
+            m_entries.erase(entry_it->second);
+            m_entries_map.erase(entry_it);
+        }
+
+        auto const size = m_get_size(value);
+
+        m_entries.emplace_front(key, value, size);
+        m_entries_map[key] = m_entries.begin();
+        m_size += size;
+
+        // The value just put is kept even if it alone exceeds the limit
+        while (m_size > M_SIZE_MAX && m_entries.size() > 1)
+        {
+            auto const& entry_last = m_entries.back();
+
+            m_size -= std::get<2>(entry_last);
+            m_entries_map.erase(std::get<0>(entry_last));
+            m_entries.pop_back();
+        }
+    }
+
+    Value get(Key const& key, std::function<Value()> const& compute)
+    {
+        bool value_found;
+        Value value;
+        std::tie(value_found, value) = find(key);
+
+        if (!value_found)
+        {
+            value = compute();
+            put(key, value);
+        }
+
+        return value;
+    }
+
+private:
+    size_t const M_SIZE_MAX;
+    std::function<size_t(Value const&)> m_get_size;
+
+    std::list<std::tuple<Key, Value, size_t>> m_entries;
+    std::map<Key, typename std::list<std::tuple<Key, Value, size_t>>::iterator> m_entries_map;
+    size_t m_size;
+};
+
+
+size_t get_size(cv::Mat const& image)
+{
+    return image.total() * image.elemSize();
+}
+
+
+size_t get_size(ng::DetectionResult const& detection_result)
+{
+    return
+        get_size(detection_result.cross_locs_main_mat) +
+        get_size(detection_result.cross_locs_top_mat) +
+        get_size(detection_result.cross_locs_left_mat);
+}
+
+
+// Every stage is cached by the parameters it depends on,
+// so a trackbar change recomputes only the stages after the changed parameter.
+// The detection runs on a worker thread for the latest parameters only, a newer change cancels the run.
+// A low resolution preview is shown first, then the full result
 class WindowTrackbarDetector
 {
 public:
@@ -17,7 +142,33 @@ public:
         , m_resize_width_height_max(1000)
         , m_threshold_block_size(3)
         , m_threshold_c(0.0)
+        , m_images_resized(M_CACHE_SIZE_MAX, [](cv::Mat const& image) { return get_size(image); })
+        , m_images_gray(M_CACHE_SIZE_MAX, [](cv::Mat const& image) { return get_size(image); })
+        , m_images_thresholded(M_CACHE_SIZE_MAX, [](cv::Mat const& image) { return get_size(image); })
+        , m_detection_results(
+            M_CACHE_SIZE_MAX,
+            [](ng::DetectionResult const& detection_result) { return get_size(detection_result); })
+        , m_is_requested(false)
+        , m_is_stopping(false)
+        , m_is_frame_ready(false)
+        , m_overlay_renderer(M_DISPLAY_WIDTH_HEIGHT_MAX)
+    {
+        // The image does not change, it is resized for the overlay once
+        m_overlay_renderer.set_image(m_image);
+
+        m_worker = std::thread(&WindowTrackbarDetector::run, this);
+    }
+
+    ~WindowTrackbarDetector()
     {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stopping = true;
+            m_cancellation_token.cancel();
+        }
+
+        m_is_requested_changed.notify_one();
+        m_worker.join();
     }
 
     void show()
@@ -52,9 +203,26 @@ public:
             on_change_c,
             this);
 
-        draw();
+        request();
+
+        // The trackbar callbacks run inside waitKey, the frames from the worker are shown between them
+        while (cv::waitKey(M_POLL_DELAY_MS) == -1)
+        {
+            cv::Mat image_draw;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (!m_is_frame_ready)
+                {
+                    continue;
+                }
 
-        cv::waitKey();
+                image_draw = m_image_draw;
+                m_is_frame_ready = false;
+            }
+
+            cv::imshow(m_window_name, image_draw);
+        }
     }
 
     static void on_change_resize_width_height_max(int trackbar_position, void* object_p)
@@ -64,7 +232,7 @@ public:
         auto const resize_width_height_max = 10 * trackbar_position + 500;
         object.m_resize_width_height_max = resize_width_height_max;
 
-        object.draw();
+        object.request();
     }
 
     static void on_change_block_size(int trackbar_position, void* object_p)
@@ -74,7 +242,7 @@ public:
         auto const block_size = 2 * trackbar_position + 3;
         object.m_threshold_block_size = block_size;
 
-        object.draw();
+        object.request();
     }
 
     static void on_change_c(int trackbar_position, void* object_p)
@@ -84,36 +252,23 @@ public:
         auto const c = trackbar_position - 50.0;
         object.m_threshold_c = c;
 
-        object.draw();
+        object.request();
     }
 
-    void draw()
-    {
-        ng::CrossLocsDetector cross_loc_detector(
-            m_resize_width_height_max,
-            m_threshold_block_size,
-            m_threshold_c,
-            5,
-            50,
-            0.9);
+private:
+    typedef std::tuple<float, int, double> Parameters;
 
-        bool cell_loc_found;
-        cv::Mat cross_locs_main;
-        cv::Mat cross_locs_top;
-        cv::Mat cross_locs_left;
-        std::tie(cell_loc_found, cross_locs_main, cross_locs_top, cross_locs_left) =
-            cross_loc_detector.detect(m_image);
+    static int const M_TRACKBAR_POSITION_MAX = 100;
 
-        int const radius = 2;
-        auto image_draw = ng::CrossLocsDetector::draw(m_image, cross_locs_main, radius, cv::Scalar(255, 0, 0));
-        image_draw = ng::CrossLocsDetector::draw(image_draw, cross_locs_top, radius, cv::Scalar(0, 255, 0));
-        image_draw = ng::CrossLocsDetector::draw(image_draw, cross_locs_left, radius, cv::Scalar(0, 0, 255));
+    // Bytes kept by every stage cache
+    static size_t const M_CACHE_SIZE_MAX = 256 * 1024 * 1024;
 
-        cv::imshow(m_window_name, image_draw);
-    }
+    static int const M_DISPLAY_WIDTH_HEIGHT_MAX = 1000;
 
-private:
-    static int const M_TRACKBAR_POSITION_MAX = 100;
+    static int const M_POLL_DELAY_MS = 15;
+
+    // The preview is detected on the image resized to this fraction of the requested size
+    static int const M_PREVIEW_DIVISOR = 2;
 
     std::string m_window_name;
     cv::Mat m_image;
@@ -121,12 +276,1023 @@ private:
     float m_resize_width_height_max;
     int m_threshold_block_size;
     double m_threshold_c;
+
+    // Used by the worker only
+    LruCache<float, cv::Mat> m_images_resized;
+    LruCache<float, cv::Mat> m_images_gray;
+    LruCache<Parameters, cv::Mat> m_images_thresholded;
+    LruCache<Parameters, ng::DetectionResult> m_detection_results;
+
+    std::mutex m_mutex;
+    std::condition_variable m_is_requested_changed;
+    Parameters m_parameters_requested;
+    bool m_is_requested;
+    bool m_is_stopping;
+    ng::CancellationToken m_cancellation_token;
+    cv::Mat m_image_draw;
+    bool m_is_frame_ready;
+
+    // Used by the worker only, drawing on the full image is slow for large photos
+    ng::OverlayRenderer m_overlay_renderer;
+
+    std::thread m_worker;
+
+    // Replaces the pending parameters and cancels the run for the previous ones
+    void request()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_parameters_requested =
+                std::make_tuple(m_resize_width_height_max, m_threshold_block_size, m_threshold_c);
+            m_is_requested = true;
+
+            m_cancellation_token.cancel();
+            m_cancellation_token = ng::CancellationToken();
+        }
+
+        m_is_requested_changed.notify_one();
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            Parameters parameters;
+            ng::CancellationToken cancellation_token;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_is_requested_changed.wait(lock, [this]() { return m_is_requested || m_is_stopping; });
+
+                if (m_is_stopping)
+                {
+                    return;
+                }
+
+                parameters = m_parameters_requested;
+                cancellation_token = m_cancellation_token;
+                m_is_requested = false;
+            }
+
+            ng::Deadline const deadline(cancellation_token);
+
+            for (auto const& parameters_stage : { get_parameters_preview(parameters), parameters })
+            {
+                auto const image_draw = draw(parameters_stage, deadline);
+
+                // Stale, the newer parameters are already requested
+                if (deadline.is_expired())
+                {
+                    break;
+                }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_image_draw = image_draw;
+                m_is_frame_ready = true;
+            }
+        }
+    }
+
+    static Parameters get_parameters_preview(Parameters const& parameters)
+    {
+        auto const threshold_block_size_preview =
+            std::max(3, std::get<1>(parameters) / M_PREVIEW_DIVISOR / 2 * 2 + 1);
+
+        return std::make_tuple(
+            std::get<0>(parameters) / M_PREVIEW_DIVISOR,
+            threshold_block_size_preview,
+            std::get<2>(parameters));
+    }
+
+    cv::Mat draw(Parameters const& parameters, ng::Deadline const& deadline)
+    {
+        float resize_width_height_max;
+        int threshold_block_size;
+        double threshold_c;
+        std::tie(resize_width_height_max, threshold_block_size, threshold_c) = parameters;
+
+        auto const scale = resize_width_height_max / static_cast<float>(std::max(m_image.rows, m_image.cols));
+
+        auto const image_resized = m_images_resized.get(resize_width_height_max, [&]()
+        {
+            cv::Mat image_resized;
+            cv::resize(m_image, image_resized, cv::Size(), scale, scale, cv::INTER_LINEAR);
+
+            return image_resized;
+        });
+
+        auto const image_gray = m_images_gray.get(resize_width_height_max, [&]()
+        {
+            cv::Mat image_gray;
+            cv::cvtColor(image_resized, image_gray, cv::COLOR_BGR2GRAY);
+
+            return image_gray;
+        });
+
+        auto const image_thresholded = m_images_thresholded.get(parameters, [&]()
+        {
+            return ng::threshold(image_gray, threshold_block_size, threshold_c);
+        });
+
+        // A cancelled detection is partial and is not cached
+        bool detection_result_found;
+        ng::DetectionResult detection_result;
+        std::tie(detection_result_found, detection_result) = m_detection_results.find(parameters);
+
+        if (!detection_result_found)
+        {
+            ng::CrossLocsDetector cross_loc_detector(
+                resize_width_height_max,
+                threshold_block_size,
+                threshold_c,
+                5,
+                50,
+                0.9);
+
+            detection_result = cross_loc_detector.detect_thresholded(
+                image_gray,
+                image_thresholded,
+                scale,
+                cv::Point(0, 0),
+                ng::DetectionHints(),
+                deadline);
+
+            if (!detection_result.is_partial)
+            {
+                m_detection_results.put(parameters, detection_result);
+            }
+        }
+
+        // The renderer reuses its buffer, the frame is handed to the UI thread
+        return m_overlay_renderer.render(
+            detection_result.cross_locs_main_mat,
+            detection_result.cross_locs_top_mat,
+            detection_result.cross_locs_left_mat).clone();
+    }
 };
 
 
-int main()
+// Headless mode: tunes the parameters on the sample images of one source and saves them as a named profile
+int tune(std::string const& profiles_path, std::string const& profile_name, std::vector<std::string> const& image_paths)
 {
-    std::string const image_path =
+    std::vector<cv::Mat> images;
+    for (auto const& image_path : image_paths)
+    {
+        auto image = cv::imread(image_path);
+
+        if (image.empty())
+        {
+            std::cout << "Image was not read: " << image_path << std::endl;
+
+            return 1;
+        }
+
+        images.push_back(image);
+    }
+
+    ng::ThresholdTuner threshold_tuner(5, 50, 0.9);
+
+    auto const start = std::chrono::steady_clock::now();
+
+    bool threshold_profile_found;
+    ng::ThresholdProfile threshold_profile;
+    double score;
+    std::tie(threshold_profile_found, threshold_profile, score) = threshold_tuner.tune(profile_name, images);
+
+    auto const end = std::chrono::steady_clock::now();
+    std::cout << "Tuning took " << std::chrono::duration_cast<std::chrono::seconds>(end - start).count() << " s" << std::endl;
+
+    if (!threshold_profile_found)
+    {
+        std::cout << "No candidate found the grid" << std::endl;
+
+        return 1;
+    }
+
+    std::cout << "Resize width (height) max: " << threshold_profile.resize_width_height_max << std::endl;
+    std::cout << "Block size: " << threshold_profile.threshold_block_size << std::endl;
+    std::cout << "C: " << threshold_profile.threshold_c << std::endl;
+    std::cout << "Score: " << score << std::endl;
+
+    // Keep the profiles of the other sources
+    bool threshold_profiles_loaded;
+    std::vector<ng::ThresholdProfile> threshold_profiles;
+    std::tie(threshold_profiles_loaded, threshold_profiles) = ng::load_threshold_profiles(profiles_path);
+
+    ng::upsert_threshold_profile(threshold_profiles, threshold_profile);
+
+    if (!ng::save_threshold_profiles(profiles_path, threshold_profiles))
+    {
+        std::cout << "Profiles were not saved: " << profiles_path << std::endl;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+
+bool is_equal(cv::Mat const& cross_locs_mat_1, cv::Mat const& cross_locs_mat_2)
+{
+    return
+        cross_locs_mat_1.size() == cross_locs_mat_2.size() &&
+        (cross_locs_mat_1.empty() || cv::norm(cross_locs_mat_1, cross_locs_mat_2, cv::NORM_INF) == 0.0);
+}
+
+
+bool is_equal(ng::DetectionResult const& detection_result_1, ng::DetectionResult const& detection_result_2)
+{
+    return
+        detection_result_1.is_found == detection_result_2.is_found &&
+        is_equal(detection_result_1.cross_locs_main_mat, detection_result_2.cross_locs_main_mat) &&
+        is_equal(detection_result_1.cross_locs_top_mat, detection_result_2.cross_locs_top_mat) &&
+        is_equal(detection_result_1.cross_locs_left_mat, detection_result_2.cross_locs_left_mat);
+}
+
+
+// Headless mode: runs <threads_n> threads on one shared detector, every thread with its own workspace,
+// and checks that they all get the single threaded results. Without <image_paths> the images are
+// synthetic puzzles, so CTest runs it as is. Meant to run under ThreadSanitizer, see NG_ENABLE_THREAD_SANITIZER
+int stress(int const threads_n, std::vector<std::string> const& image_paths)
+{
+    auto const ROUNDS_N = 4;
+    auto const SYNTHETIC_PUZZLES_N = 8;
+
+    std::vector<cv::Mat> images;
+    if (image_paths.empty())
+    {
+        for (auto const& synthetic_puzzle : ng::generate_synthetic_puzzles(SYNTHETIC_PUZZLES_N))
+        {
+            images.push_back(synthetic_puzzle.image);
+        }
+    }
+
+    for (auto const& image_path : image_paths)
+    {
+        auto image = cv::imread(image_path);
+
+        if (image.empty())
+        {
+            std::cout << "Image was not read: " << image_path << std::endl;
+
+            return 1;
+        }
+
+        images.push_back(image);
+    }
+
+    ng::CrossLocsDetector const cross_locs_detector(1000, 15, 10, 5, 50, 0.9);
+
+    std::vector<ng::DetectionResult> detection_results_expected;
+    for (auto const& image : images)
+    {
+        detection_results_expected.push_back(cross_locs_detector.detect(image, ng::Deadline()));
+    }
+
+    std::atomic<int> mismatches_n(0);
+
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threads_n; ++i)
+    {
+        threads.emplace_back(
+            [&, i]()
+            {
+                ng::DetectionWorkspace workspace;
+
+                // The threads start at different images, so the same images are detected concurrently at random
+                for (size_t j = 0; j < ROUNDS_N * images.size(); ++j)
+                {
+                    auto const image_index = (i + j) % images.size();
+
+                    auto const detection_result = cross_locs_detector.detect(
+                        images[image_index],
+                        ng::DetectionHints(),
+                        ng::Deadline(),
+                        workspace);
+
+                    if (!is_equal(detection_result, detection_results_expected[image_index]))
+                    {
+                        ++mismatches_n;
+                    }
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto const end = std::chrono::steady_clock::now();
+    std::cout << "Detections: " << threads_n * ROUNDS_N * images.size() << std::endl;
+    std::cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+}
+
+
+// Headless mode: detects strongly tilted synthetic puzzles with and without the lattice model prediction
+// and checks that the model never finds fewer main grid crosses than the full window search
+int check_lattice_search()
+{
+    auto const SYNTHETIC_PUZZLES_N = 16;
+    auto const PERSPECTIVE_JITTER_RATIO = 0.08f;
+
+    auto const synthetic_puzzles = ng::generate_synthetic_puzzles(SYNTHETIC_PUZZLES_N, 20191102, PERSPECTIVE_JITTER_RATIO);
+
+    ng::DetectionOptions options_full_window;
+    options_full_window.predict_from_lattice_model = false;
+
+    ng::CrossLocsDetector const cross_locs_detector(1200, 15, 10.0, 5, 50, 0.9);
+    ng::CrossLocsDetector const cross_locs_detector_full_window(1200, 15, 10.0, 5, 50, 0.9, options_full_window);
+
+    auto found_n_sum = 0;
+    auto found_n_full_window_sum = 0;
+    auto mismatches_n = 0;
+    for (size_t i = 0; i < synthetic_puzzles.size(); ++i)
+    {
+        auto const& image = synthetic_puzzles[i].image;
+
+        auto const found_n = cross_locs_detector.detect(image, ng::Deadline()).main_grid.found_n;
+        auto const found_n_full_window = cross_locs_detector_full_window.detect(image, ng::Deadline()).main_grid.found_n;
+
+        if (found_n < found_n_full_window)
+        {
+            std::cout << "Puzzle " << i << ": " << found_n << " crosses, full window " << found_n_full_window << std::endl;
+            ++mismatches_n;
+        }
+
+        found_n_sum += found_n;
+        found_n_full_window_sum += found_n_full_window;
+    }
+
+    std::cout << "Crosses: " << found_n_sum << ", full window " << found_n_full_window_sum << std::endl;
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+}
+
+
+// Headless mode: detects synthetic puzzles with DetectionOptions::cell_pitch_target, one of them with cells
+// so small that the resize scale is capped below the target, and checks that every main grid has the right size
+int check_cell_pitch_target()
+{
+    auto const CELL_PITCH_TARGET = 32;
+
+    // Cell side lengths in pixels, 9 is enlarged only to 18 by the capped scale
+    std::vector<int> const cell_side_lengths = { 9, 16, 24, 40 };
+
+    ng::DetectionOptions options;
+    options.cell_pitch_target = CELL_PITCH_TARGET;
+
+    ng::CrossLocsDetector const cross_locs_detector(1200, 15, 10.0, 5, 50, 0.9, options);
+
+    cv::RNG rng(20191102);
+
+    auto mismatches_n = 0;
+    for (auto const cell_side_length : cell_side_lengths)
+    {
+        auto const synthetic_puzzle = ng::generate_synthetic_puzzle(rng, 15, 20, cell_side_length);
+
+        auto const detection_result = cross_locs_detector.detect(synthetic_puzzle.image, ng::Deadline());
+
+        if (detection_result.cross_locs_main_mat.size() != synthetic_puzzle.cross_locs_main_mat.size())
+        {
+            std::cout
+                << "Cell side length " << cell_side_length << ": main grid " << detection_result.cross_locs_main_mat.size()
+                << ", expected " << synthetic_puzzle.cross_locs_main_mat.size() << std::endl;
+            ++mismatches_n;
+        }
+    }
+
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+}
+
+
+#ifndef _WIN32
+
+// The frames follow the protocol in detection_server.hpp on their own, so the check does not share the bugs
+// of the server's framing
+bool write_frame(int const fd, uint32_t const size, std::vector<unsigned char> const& payload)
+{
+    std::vector<unsigned char> frame = {
+        static_cast<unsigned char>(size),
+        static_cast<unsigned char>(size >> 8),
+        static_cast<unsigned char>(size >> 16),
+        static_cast<unsigned char>(size >> 24) };
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    return ::write(fd, frame.data(), frame.size()) == static_cast<ssize_t>(frame.size());
+}
+
+
+bool read_all(int const fd, unsigned char* data, size_t const size)
+{
+    size_t size_read = 0;
+    while (size_read < size)
+    {
+        auto const result = ::read(fd, data + size_read, size - size_read);
+        if (result <= 0)
+        {
+            return false;
+        }
+
+        size_read += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+
+// The boolean flag shows if the response was received and holds a valid record
+std::tuple<bool, ng::DetectionResponseStatus, ng::GridRecord> send_request(
+    int const fd,
+    std::vector<unsigned char> const& request)
+{
+    unsigned char size_bytes[4];
+    if (!write_frame(fd, static_cast<uint32_t>(request.size()), request) || !read_all(fd, size_bytes, sizeof(size_bytes)))
+    {
+        return std::make_tuple(false, ng::DetectionResponseStatus::FAILED, ng::GridRecord());
+    }
+
+    auto const size =
+        static_cast<uint32_t>(size_bytes[0]) |
+        static_cast<uint32_t>(size_bytes[1]) << 8 |
+        static_cast<uint32_t>(size_bytes[2]) << 16 |
+        static_cast<uint32_t>(size_bytes[3]) << 24;
+
+    std::vector<unsigned char> response(size);
+    if (size == 0 || !read_all(fd, response.data(), size))
+    {
+        return std::make_tuple(false, ng::DetectionResponseStatus::FAILED, ng::GridRecord());
+    }
+
+    bool grid_record_decoded;
+    ng::GridRecord grid_record;
+    std::tie(grid_record_decoded, grid_record) = ng::decode_grid_record(response.data() + 1, response.size() - 1);
+
+    return std::make_tuple(grid_record_decoded, static_cast<ng::DetectionResponseStatus>(response.front()), grid_record);
+}
+
+#endif
+
+
+// Headless mode: serves a socket pair with DetectionServer::serve_stream and checks the responses to a puzzle image,
+// an undecodable image and malformed requests, then that a broken frame ends the stream instead of the process
+int check_server()
+{
+#ifdef _WIN32
+    std::cout << "The detection server is Unix only" << std::endl;
+
+    return 0;
+#else
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        std::cout << "Socket pair was not created" << std::endl;
+
+        return 1;
+    }
+
+    ng::ThresholdProfile const threshold_profile;
+    ng::CrossLocsDetector const cross_locs_detector(threshold_profile, 5, 50, 0.9);
+
+    ng::DetectionServerOptions server_options;
+    server_options.workers_n = 2;
+    server_options.queue_capacity = 2;
+
+    ng::DetectionServer detection_server(cross_locs_detector, threshold_profile, server_options);
+
+    auto served = false;
+    std::thread server_thread([&]() { served = detection_server.serve_stream(fds[1], fds[1]); });
+
+    auto const make_request = [](ng::DetectionRequestType const request_type, std::vector<unsigned char> const& data)
+    {
+        std::vector<unsigned char> request = { static_cast<unsigned char>(request_type) };
+        request.insert(request.end(), data.begin(), data.end());
+
+        return request;
+    };
+
+    std::vector<unsigned char> puzzle_png;
+    cv::RNG rng(20191102);
+    cv::imencode(".png", ng::generate_synthetic_puzzle(rng, 10, 15, 30).image, puzzle_png);
+
+    std::string const path_missing = "missing/puzzle.png";
+
+    // (name, request, expected status)
+    std::vector<std::tuple<std::string, std::vector<unsigned char>, ng::DetectionResponseStatus>> const cases = {
+        std::make_tuple(
+            "puzzle",
+            make_request(ng::DetectionRequestType::IMAGE, puzzle_png),
+            ng::DetectionResponseStatus::OK),
+        std::make_tuple(
+            "undecodable image",
+            make_request(ng::DetectionRequestType::IMAGE, std::vector<unsigned char>(1000, 0x5a)),
+            ng::DetectionResponseStatus::NOT_DECODED),
+        std::make_tuple(
+            "missing path",
+            make_request(ng::DetectionRequestType::PATH, std::vector<unsigned char>(path_missing.begin(), path_missing.end())),
+            ng::DetectionResponseStatus::NOT_DECODED),
+        std::make_tuple(
+            "empty request",
+            std::vector<unsigned char>(),
+            ng::DetectionResponseStatus::FAILED),
+        std::make_tuple(
+            "unknown request type",
+            std::vector<unsigned char>{ 0x7f, 1, 2, 3 },
+            ng::DetectionResponseStatus::FAILED),
+        std::make_tuple(
+            "puzzle after the failures",
+            make_request(ng::DetectionRequestType::IMAGE, puzzle_png),
+            ng::DetectionResponseStatus::OK) };
+
+    auto mismatches_n = 0;
+    for (auto const& test_case : cases)
+    {
+        bool response_received;
+        ng::DetectionResponseStatus status;
+        ng::GridRecord grid_record;
+        std::tie(response_received, status, grid_record) = send_request(fds[0], std::get<1>(test_case));
+
+        auto const is_expected =
+            response_received &&
+            status == std::get<2>(test_case) &&
+            (status != ng::DetectionResponseStatus::OK || grid_record.detection_result.is_found);
+
+        if (!is_expected)
+        {
+            std::cout
+                << std::get<0>(test_case) << ": " << (response_received ? "status " : "no response, status ")
+                << static_cast<int>(status) << std::endl;
+            ++mismatches_n;
+        }
+    }
+
+    // A frame larger than the server accepts ends the stream
+    if (!write_frame(fds[0], 0xffffffff, std::vector<unsigned char>()))
+    {
+        ++mismatches_n;
+    }
+
+    server_thread.join();
+
+    if (!served)
+    {
+        std::cout << "broken frame: the stream failed" << std::endl;
+        ++mismatches_n;
+    }
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+#endif
+}
+
+
+// Lattice with noisy crosses, some of them not found
+cv::Mat generate_cross_locs_mat(cv::RNG& rng, int const rows, int const cols)
+{
+    cv::Mat cross_locs_mat(rows, cols, CV_32SC2);
+
+    auto const origin = cv::Point2f(rng.uniform(0.0f, 500.0f), rng.uniform(0.0f, 500.0f));
+    auto const row_step = cv::Point2f(rng.uniform(-2.0f, 2.0f), rng.uniform(10.0f, 40.0f));
+    auto const col_step = cv::Point2f(rng.uniform(10.0f, 40.0f), rng.uniform(-2.0f, 2.0f));
+
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            auto const cross_loc = origin + i * row_step + j * col_step;
+
+            cross_locs_mat.at<cv::Vec2i>(i, j) = rng.uniform(0, 10) == 0 ?
+                cv::Vec2i(-1, -1) :
+                cv::Vec2i(
+                    cvRound(cross_loc.x) + rng.uniform(-2, 3),
+                    cvRound(cross_loc.y) + rng.uniform(-2, 3));
+        }
+    }
+
+    return cross_locs_mat;
+}
+
+
+ng::StageProgress generate_stage_progress(cv::RNG& rng)
+{
+    ng::StageProgress stage_progress;
+    stage_progress.is_completed = rng.uniform(0, 2) == 1;
+    stage_progress.found_n = rng.uniform(0, 100000);
+    stage_progress.holes_n = rng.uniform(0, 1000);
+
+    return stage_progress;
+}
+
+
+ng::GridRecord generate_grid_record(cv::RNG& rng, int const index)
+{
+    ng::GridRecord grid_record;
+    grid_record.source = "images/sample_" + std::to_string(index) + ".jpg";
+
+    grid_record.threshold_profile.name = "profile_" + std::to_string(index);
+    grid_record.threshold_profile.resize_width_height_max = static_cast<float>(rng.uniform(500, 2000));
+    grid_record.threshold_profile.threshold_block_size = 2 * rng.uniform(1, 20) + 1;
+    grid_record.threshold_profile.threshold_c = rng.uniform(-20, 20) / 4.0;
+
+    auto& detection_result = grid_record.detection_result;
+    detection_result.is_found = rng.uniform(0, 2) == 1;
+    detection_result.is_partial = rng.uniform(0, 2) == 1;
+    detection_result.scale = rng.uniform(1, 64) / 64.0f;
+    detection_result.cell_pitch = rng.uniform(40, 400) / 8.0f;
+
+    detection_result.seed = generate_stage_progress(rng);
+    detection_result.main_grid = generate_stage_progress(rng);
+    detection_result.top_grid = generate_stage_progress(rng);
+    detection_result.left_grid = generate_stage_progress(rng);
+
+    // Beyond the int range on purpose
+    detection_result.allocations.allocations_n = rng.uniform(0, 100000);
+    detection_result.allocations.allocated_bytes_n = static_cast<int64_t>(rng.uniform(0, 100000)) << 20;
+    detection_result.allocations.peak_live_bytes_n = static_cast<int64_t>(rng.uniform(0, 100000)) << 16;
+
+    // The first record is not found and has no grids
+    if (index > 0)
+    {
+        auto const rows = rng.uniform(5, 40);
+        auto const cols = rng.uniform(5, 40);
+        detection_result.cross_locs_main_mat = generate_cross_locs_mat(rng, rows, cols);
+        detection_result.cross_locs_top_mat = generate_cross_locs_mat(rng, rng.uniform(1, 10), cols);
+        detection_result.cross_locs_left_mat = generate_cross_locs_mat(rng, rows, rng.uniform(1, 10));
+    }
+
+    return grid_record;
+}
+
+
+bool is_equal(ng::StageProgress const& stage_progress_1, ng::StageProgress const& stage_progress_2)
+{
+    return
+        stage_progress_1.is_completed == stage_progress_2.is_completed &&
+        stage_progress_1.found_n == stage_progress_2.found_n &&
+        stage_progress_1.holes_n == stage_progress_2.holes_n;
+}
+
+
+// Every field, unlike the result comparison of the stress mode
+bool is_equal(ng::GridRecord const& grid_record_1, ng::GridRecord const& grid_record_2)
+{
+    auto const& threshold_profile_1 = grid_record_1.threshold_profile;
+    auto const& threshold_profile_2 = grid_record_2.threshold_profile;
+    auto const& detection_result_1 = grid_record_1.detection_result;
+    auto const& detection_result_2 = grid_record_2.detection_result;
+
+    return
+        grid_record_1.source == grid_record_2.source &&
+        threshold_profile_1.name == threshold_profile_2.name &&
+        threshold_profile_1.resize_width_height_max == threshold_profile_2.resize_width_height_max &&
+        threshold_profile_1.threshold_block_size == threshold_profile_2.threshold_block_size &&
+        threshold_profile_1.threshold_c == threshold_profile_2.threshold_c &&
+        is_equal(detection_result_1, detection_result_2) &&
+        detection_result_1.is_partial == detection_result_2.is_partial &&
+        detection_result_1.scale == detection_result_2.scale &&
+        detection_result_1.cell_pitch == detection_result_2.cell_pitch &&
+        is_equal(detection_result_1.seed, detection_result_2.seed) &&
+        is_equal(detection_result_1.main_grid, detection_result_2.main_grid) &&
+        is_equal(detection_result_1.top_grid, detection_result_2.top_grid) &&
+        is_equal(detection_result_1.left_grid, detection_result_2.left_grid) &&
+        detection_result_1.allocations.allocations_n == detection_result_2.allocations.allocations_n &&
+        detection_result_1.allocations.allocated_bytes_n == detection_result_2.allocations.allocated_bytes_n &&
+        detection_result_1.allocations.peak_live_bytes_n == detection_result_2.allocations.peak_live_bytes_n;
+}
+
+
+std::vector<char> read_file(std::string const& file_path)
+{
+    std::ifstream file(file_path, std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+
+bool write_file(std::string const& file_path, std::vector<char> const& data)
+{
+    std::ofstream file(file_path, std::ios::binary);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    return static_cast<bool>(file);
+}
+
+
+// Cells of random sizes and contents, every other one a non-continuous view of a larger image
+std::vector<std::vector<cv::Mat>> generate_cell_images(cv::RNG& rng, int const rows, int const cols)
+{
+    std::vector<std::vector<cv::Mat>> cell_images(rows);
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int col = 0; col < cols; ++col)
+        {
+            cv::Mat cell_image_outer(rng.uniform(8, 40), rng.uniform(8, 40), CV_8U);
+            rng.fill(cell_image_outer, cv::RNG::UNIFORM, 0, 256);
+
+            cell_images[row].push_back((row + col) % 2 == 0 ?
+                cell_image_outer :
+                cell_image_outer(cv::Rect(1, 1, cell_image_outer.cols - 2, cell_image_outer.rows - 2)));
+        }
+    }
+
+    return cell_images;
+}
+
+
+// Headless mode: writes a cell archive to <output_prefix>.cells, maps it and compares every cell,
+// then checks that truncated copies and a copy with a bad cell type are rejected
+int check_cell_archive(std::string const& output_prefix)
+{
+    cv::RNG rng(20191102);
+
+    std::vector<std::pair<ng::CellArea, std::vector<std::vector<cv::Mat>>>> const areas = {
+        std::make_pair(ng::CellArea::MAIN, generate_cell_images(rng, 10, 15)),
+        std::make_pair(ng::CellArea::TOP, generate_cell_images(rng, 4, 15)),
+        std::make_pair(ng::CellArea::LEFT, generate_cell_images(rng, 10, 3)) };
+
+    ng::CellArchiveWriter cell_archive_writer;
+    size_t cells_n = 0;
+    for (auto const& area : areas)
+    {
+        cell_archive_writer.add(area.first, area.second);
+        cells_n += area.second.size() * area.second.front().size();
+    }
+
+    auto const cell_archive_path = output_prefix + ".cells";
+    if (!cell_archive_writer.write(cell_archive_path))
+    {
+        std::cout << "Cell archive was not written: " << cell_archive_path << std::endl;
+
+        return 1;
+    }
+
+    auto mismatches_n = 0;
+
+    {
+        ng::CellArchiveReader cell_archive_reader;
+        if (!cell_archive_reader.open(cell_archive_path))
+        {
+            std::cout << "Cell archive was not read: " << cell_archive_path << std::endl;
+
+            return 1;
+        }
+
+        if (cell_archive_reader.get_entries().size() != cells_n)
+        {
+            std::cout << "Cells: " << cell_archive_reader.get_entries().size() << " of " << cells_n << std::endl;
+            ++mismatches_n;
+        }
+
+        for (auto const& area : areas)
+        {
+            auto const& cell_images = area.second;
+            for (int row = 0; row < static_cast<int>(cell_images.size()); ++row)
+            {
+                for (int col = 0; col < static_cast<int>(cell_images[row].size()); ++col)
+                {
+                    bool cell_image_found;
+                    cv::Mat cell_image;
+                    std::tie(cell_image_found, cell_image) = cell_archive_reader.find_cell_image(area.first, row, col);
+
+                    auto const& cell_image_expected = cell_images[row][col];
+                    if (!cell_image_found ||
+                        cell_image.type() != cell_image_expected.type() ||
+                        !is_equal(cell_image, cell_image_expected))
+                    {
+                        std::cout
+                            << "Cell " << static_cast<int>(area.first) << " " << row << " " << col << " differs" << std::endl;
+                        ++mismatches_n;
+                    }
+                }
+            }
+
+            // One past the last row
+            if (cell_archive_reader.find_cell_image(area.first, static_cast<int>(cell_images.size()), 0).first)
+            {
+                std::cout << "Cell past area " << static_cast<int>(area.first) << " was found" << std::endl;
+                ++mismatches_n;
+            }
+        }
+    }
+
+    auto const data = read_file(cell_archive_path);
+
+    // Within the header, within the index and within the last cell
+    auto const entries_offset = sizeof(ng::CellArchiveHeader);
+    std::vector<size_t> const truncated_sizes = {
+        entries_offset - 1,
+        entries_offset + sizeof(ng::CellArchiveEntry) / 2,
+        data.size() - 1 };
+
+    std::vector<std::pair<std::string, std::vector<char>>> broken_copies;
+    for (auto const truncated_size : truncated_sizes)
+    {
+        broken_copies.emplace_back(
+            "truncated to " + std::to_string(truncated_size),
+            std::vector<char>(data.begin(), data.begin() + truncated_size));
+    }
+
+    for (auto const type_bad : { -1, 4096, CV_MAKETYPE(7, 1) })
+    {
+        auto data_bad = data;
+        std::memcpy(&data_bad[entries_offset + offsetof(ng::CellArchiveEntry, type)], &type_bad, sizeof(type_bad));
+
+        broken_copies.emplace_back("type " + std::to_string(type_bad), data_bad);
+    }
+
+    auto const broken_path = output_prefix + "_broken.cells";
+    for (auto const& broken_copy : broken_copies)
+    {
+        ng::CellArchiveReader cell_archive_reader;
+        if (!write_file(broken_path, broken_copy.second) || cell_archive_reader.open(broken_path))
+        {
+            std::cout << "Broken archive was accepted: " << broken_copy.first << std::endl;
+            ++mismatches_n;
+        }
+    }
+
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+}
+
+
+// Headless mode: writes synthetic records in both formats to <output_prefix>.ngr and <output_prefix>.json,
+// reads them back and checks that every field survived
+int check_serialization(std::string const& output_prefix)
+{
+    auto const RECORDS_N = 16;
+
+    cv::RNG rng(20191102);
+
+    std::vector<ng::GridRecord> grid_records;
+    for (int i = 0; i < RECORDS_N; ++i)
+    {
+        grid_records.push_back(generate_grid_record(rng, i));
+    }
+
+    auto mismatches_n = 0;
+
+    std::vector<std::pair<std::string, ng::GridRecordFormat>> const outputs = {
+        std::make_pair(output_prefix + ".ngr", ng::GridRecordFormat::BINARY),
+        std::make_pair(output_prefix + ".json", ng::GridRecordFormat::JSON)};
+
+    for (auto const& output : outputs)
+    {
+        auto const& output_path = output.first;
+
+        ng::GridRecordWriter grid_record_writer;
+        if (!grid_record_writer.open(output_path, output.second))
+        {
+            std::cout << "Records were not written: " << output_path << std::endl;
+
+            return 1;
+        }
+
+        for (auto const& grid_record : grid_records)
+        {
+            grid_record_writer.write(grid_record);
+        }
+
+        if (!grid_record_writer.close())
+        {
+            std::cout << "Records were not written: " << output_path << std::endl;
+
+            return 1;
+        }
+
+        ng::GridRecordReader grid_record_reader;
+        if (!grid_record_reader.open(output_path))
+        {
+            std::cout << "Records were not read: " << output_path << std::endl;
+
+            return 1;
+        }
+
+        size_t records_read_n = 0;
+        while (true)
+        {
+            bool grid_record_read;
+            ng::GridRecord grid_record;
+            std::tie(grid_record_read, grid_record) = grid_record_reader.read();
+
+            if (!grid_record_read)
+            {
+                break;
+            }
+
+            if (records_read_n >= grid_records.size() || !is_equal(grid_record, grid_records[records_read_n]))
+            {
+                std::cout << "Record " << records_read_n << " differs: " << output_path << std::endl;
+                ++mismatches_n;
+            }
+
+            ++records_read_n;
+        }
+
+        if (records_read_n != grid_records.size())
+        {
+            std::cout << "Records read: " << records_read_n << " of " << grid_records.size() << ": " << output_path << std::endl;
+            ++mismatches_n;
+        }
+    }
+
+    std::cout << "Mismatches: " << mismatches_n << std::endl;
+
+    return mismatches_n == 0 ? 0 : 1;
+}
+
+
+// Usage:
+//   nonogram_detector_test [image_path]
+//   nonogram_detector_test --tune profiles_path profile_name image_path...
+//   nonogram_detector_test --stress threads_n [image_path...]
+//   nonogram_detector_test --check-serialization output_prefix
+//   nonogram_detector_test --check-cell-archive output_prefix
+//   nonogram_detector_test --check-lattice-search
+//   nonogram_detector_test --check-cell-pitch-target
+//   nonogram_detector_test --check-server
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> const arguments(argv + 1, argv + argc);
+
+    if (!arguments.empty() && arguments.front() == "--tune")
+    {
+        if (arguments.size() < 4)
+        {
+            std::cout << "Usage: nonogram_detector_test --tune profiles_path profile_name image_path..." << std::endl;
+
+            return 1;
+        }
+
+        return tune(arguments[1], arguments[2], std::vector<std::string>(arguments.begin() + 3, arguments.end()));
+    }
+
+    if (!arguments.empty() && arguments.front() == "--stress")
+    {
+        if (arguments.size() < 2)
+        {
+            std::cout << "Usage: nonogram_detector_test --stress threads_n [image_path...]" << std::endl;
+
+            return 1;
+        }
+
+        return stress(std::stoi(arguments[1]), std::vector<std::string>(arguments.begin() + 2, arguments.end()));
+    }
+
+    if (!arguments.empty() && arguments.front() == "--check-lattice-search")
+    {
+        return check_lattice_search();
+    }
+
+    if (!arguments.empty() && arguments.front() == "--check-cell-pitch-target")
+    {
+        return check_cell_pitch_target();
+    }
+
+    if (!arguments.empty() && arguments.front() == "--check-server")
+    {
+        return check_server();
+    }
+
+    if (!arguments.empty() && arguments.front() == "--check-cell-archive")
+    {
+        if (arguments.size() != 2)
+        {
+            std::cout << "Usage: nonogram_detector_test --check-cell-archive output_prefix" << std::endl;
+
+            return 1;
+        }
+
+        return check_cell_archive(arguments[1]);
+    }
+
+    if (!arguments.empty() && arguments.front() == "--check-serialization")
+    {
+        if (arguments.size() != 2)
+        {
+            std::cout << "Usage: nonogram_detector_test --check-serialization output_prefix" << std::endl;
+
+            return 1;
+        }
+
+        return check_serialization(arguments[1]);
+    }
+
+    std::string const image_path = !arguments.empty() ?
+        arguments.front() :
         R"(C:\Users\klimenkov\Desktop\nonograms\nonogram.jpg)";
 
     auto image = cv::imread(image_path);